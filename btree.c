@@ -28,86 +28,239 @@ uint32_t* node_prev(void* node) {
   return node + NODE_PREV_OFFSET;
 }
 
-uint32_t* node_parent(void* node) { return node + PARENT_POINTER_OFFSET; }
 
 
-uint32_t get_node_max_key(Pager* pager, void* node) {
-  if (get_node_type(node) == NODE_LEAF) {
-    return *leaf_node_key(node, *leaf_node_num_cells(node) - 1);
+// Keys that only ever grow land past the last key of the rightmost leaf. When
+// the path to that leaf is still current, the cursor is placed at its end
+// without searching any internal node.
+static bool table_find_rightmost(Table* table, uint32_t key, Cursor* cursor) {
+  if (table->rightmost_page_num == INVALID_PAGE_NUM ||
+      table->rightmost_version != table->tree_version) {
+    return false;
   }
-  void* right_child = get_page(pager,*internal_node_right_child(node));
-  return get_node_max_key(pager, right_child);
+  void* node = get_page(table->pager, table->rightmost_page_num);
+  uint32_t num_cells = *leaf_node_num_cells(node);
+  if (num_cells == 0 || key <= *leaf_node_key(node, num_cells - 1)) {
+    return false;
+  }
+  cursor->table = table;
+  cursor->page_num = table->rightmost_page_num;
+  cursor->cell_num = num_cells;
+  cursor->end_of_table = false;
+  cursor->path = table->rightmost_path;
+  cursor->readahead_window = 0;
+  cursor->readahead_ahead = 0;
+  return true;
 }
 
-Cursor* table_find(Table* table, uint32_t key) {
-  uint32_t root_page_num = table->root_page_num;
-  void* root_node = get_page(table->pager, root_page_num);
+// Walks from the root down to the leaf that holds key, or where it would be
+// inserted. Each internal node passed and the child taken there is recorded in
+// cursor->path, so an insert or delete can fix up the ancestors afterwards
+// without another search.
+void table_find(Table* table, uint32_t key, Cursor* cursor) {
+  if (table_find_rightmost(table, key, cursor)) {
+    return;
+  }
+  TreePath* path = &cursor->path;
+  path->depth = 0;
+
+  bool rightmost = true;
+  uint32_t page_num = table->root_page_num;
+  void* node = get_page(table->pager, page_num);
+  while (get_node_type(node) == NODE_INTERNAL) {
+    if (path->depth == TREE_MAX_HEIGHT) {
+      printf("Tree is deeper than %d levels. Corrupt file.\n", TREE_MAX_HEIGHT);
+      exit(EXIT_FAILURE);
+    }
+    uint32_t child_index = internal_node_find_child(node, key);
+    path->page_nums[path->depth] = page_num;
+    path->child_indexes[path->depth] = child_index;
+    path->depth++;
+    rightmost = rightmost && child_index == *internal_node_num_keys(node);
 
-  if (get_node_type(root_node) == NODE_LEAF) {
-    return leaf_node_find(table, root_page_num, key);
-  } else {
-    return internal_node_find(table, root_page_num, key);
+    page_num = *internal_node_child(node, child_index);
+    node = get_page(table->pager, page_num);
+  }
+  leaf_node_find(table, page_num, key, cursor);
+
+  if (rightmost) {
+    table->rightmost_path = *path;
+    table->rightmost_page_num = page_num;
+    table->rightmost_version = table->tree_version;
   }
 }
 
-void create_new_root(Table* table, uint32_t right_child_page_num) {
+// Copies the row with key into row and returns true, or returns false if
+// there is none. Unlike table_find(), each page is unpinned as soon as it is
+// read, so a statement that looks up many rows, one at a time, does not keep
+// every page it passed pinned until it ends.
+bool table_get_row(Table* table, uint32_t key, Row* row) {
+  Pager* pager = table->pager;
+  uint32_t page_num = table->root_page_num;
+  void* node = get_page(pager, page_num);
+  unpin_page(pager, page_num);
+  while (get_node_type(node) == NODE_INTERNAL) {
+    page_num = *internal_node_child(node, internal_node_find_child(node, key));
+    node = get_page(pager, page_num);
+    unpin_page(pager, page_num);
+  }
+  uint32_t num_cells = *leaf_node_num_cells(node);
+  uint32_t cell_num = key_search(leaf_node_slot(node, 0), num_cells, key);
+  if (cell_num >= num_cells || *leaf_node_key(node, cell_num) != key) {
+    return false;
+  }
+  deserialize_row(leaf_node_value(node, cell_num), row);
+  return true;
+}
 
-  void* root = get_page(table->pager, table->root_page_num);
-  void* right_child = get_page(table->pager, right_child_page_num);
-  uint32_t left_child_page_num = get_unused_page_num(table->pager);
-  void* left_child = get_page(table->pager, left_child_page_num);
-
-  if (get_node_type(root) == NODE_INTERNAL) {
-    initialize_internal_node(right_child);
-    initialize_internal_node(left_child);
-  }
-  memcpy(left_child, root, PAGE_SIZE);
-  set_node_root(left_child, false);
-
-  if (get_node_type(left_child) == NODE_INTERNAL) {
-    void* child;
-    for (int i = 0; i < *internal_node_num_keys(left_child); i++) {
-      child = get_page(table->pager, *internal_node_child(left_child,i));
-      *node_parent(child) = left_child_page_num;
+// Steps the path on to the leaf after the one it ends at and returns that
+// leaf's page number, or INVALID_PAGE_NUM after the last leaf. Only internal
+// nodes are read.
+uint32_t tree_path_next_leaf(Pager* pager, TreePath* path) {
+  void* node = NULL;
+  int32_t level = (int32_t)path->depth - 1;
+  for (; level >= 0; level--) {
+    node = get_page(pager, path->page_nums[level]);
+    unpin_page(pager, path->page_nums[level]);
+    if (path->child_indexes[level] < *internal_node_num_keys(node)) {
+      path->child_indexes[level]++;
+      break;
     }
-    child = get_page(table->pager, *internal_node_right_child(left_child));
-    *node_parent(child) = left_child_page_num;
+  }
+  if (level < 0) {
+    return INVALID_PAGE_NUM;
   }
 
-  initialize_internal_node(root);
-  set_node_root(root, true);
-  *internal_node_num_keys(root) = 1;
-  *internal_node_child(root, 0) = left_child_page_num;
-  uint32_t left_child_max_key = get_node_max_key(table->pager, left_child);
-  *internal_node_key(root, 0) = left_child_max_key;
-  *internal_node_right_child(root) = right_child_page_num;
-  *node_parent(left_child) = table->root_page_num;
-  *node_parent(right_child) = table->root_page_num;
-  *node_next(left_child) = right_child_page_num;
-  *node_prev(right_child) = left_child_page_num;
+  uint32_t page_num = *internal_node_child(node, path->child_indexes[level]);
+  for (uint32_t i = level + 1; i < path->depth; i++) {
+    path->page_nums[i] = page_num;
+    path->child_indexes[i] = 0;
+    node = get_page(pager, page_num);
+    unpin_page(pager, page_num);
+    page_num = *internal_node_child(node, 0);
+  }
+  return page_num;
 }
 
-void delete_from_root(Table* table, uint32_t key){
-  void * root = get_page(table->pager, table->root_page_num);
-  uint32_t num = *internal_node_num_keys(root);
-  if(num==1){
-    uint32_t new_root_no = *internal_node_right_child(root);
-    void* new_root = get_page(table->pager,new_root_no);
-
-    delete_page(table->pager,table->root_page_num);   
-    table->root_page_num = new_root_no;
-    *node_parent(new_root) = INVALID_PAGE_NUM;
-    *table_root(table->pager) = new_root_no;
-    set_node_root(new_root,true);
-    *node_prev(new_root) = INVALID_PAGE_NUM;
-    *node_next(new_root) = INVALID_PAGE_NUM;
-
-    
-    return;
+// Finds the separator above the leaf the path ends at: the key of the nearest
+// ancestor where the path does not take the right child. Every key that
+// belongs in the leaf is at most that. Returns false for the rightmost leaf,
+// which has no bound.
+static bool tree_path_leaf_bound(Pager* pager, TreePath* path, uint32_t* bound) {
+  for (int32_t level = (int32_t)path->depth - 1; level >= 0; level--) {
+    void* node = get_page(pager, path->page_nums[level]);
+    if (path->child_indexes[level] < *internal_node_num_keys(node)) {
+      *bound = *internal_node_key(node, path->child_indexes[level]);
+      return true;
+    }
+  }
+  return false;
+}
+
+// Inserts a batch of rows as one statement. The batch is sorted, then each
+// descent places the whole run of following rows that fall under the same
+// leaf's separator, for as long as the leaf has room. Rows whose id is
+// already in the table, or earlier in the batch, are skipped. The rows
+// inserted are added to the indexes once the table has them all. Returns the
+// number of rows inserted.
+uint32_t table_insert_batch(Table* table, Row* rows, uint32_t num_rows) {
+  Pager* pager = table->pager;
+  uint64_t* sort_keys = sort_rows_by_id(rows, num_rows);
+  Row** sorted = malloc(num_rows * sizeof(Row*));
+  uint32_t num_sorted = 0;
+  for (uint32_t i = 0; i < num_rows; i++) {
+    Row* row = &rows[(uint32_t)sort_keys[i]];
+    if (num_sorted == 0 || sorted[num_sorted - 1]->id != row->id) {
+      sorted[num_sorted++] = row;
+    }
+  }
+  free(sort_keys);
+
+  uint32_t inserted = 0;
+  uint32_t i = 0;
+  while (i < num_sorted) {
+    Cursor cursor;
+    table_find(table, sorted[i]->id, &cursor);
+    void* node = get_page(pager, cursor.page_num);
+    uint32_t num_cells = *leaf_node_num_cells(node);
+    if (!leaf_node_has_room(pager, node, serialized_row_size(sorted[i]))) {
+      // A full leaf splits on the next row, just as for a single insert.
+      if (cursor.cell_num == num_cells ||
+          *leaf_node_key(node, cursor.cell_num) != sorted[i]->id) {
+        leaf_node_insert(&cursor, sorted[i]->id, sorted[i]);
+        inserted++;
+      } else {
+        sorted[i] = NULL;
+      }
+      i++;
+      continue;
+    }
+
+    uint32_t end = i + LEAF_NODE_MAX_CELLS(pager) - num_cells;
+    if (end > num_sorted) {
+      end = num_sorted;
+    }
+    uint32_t bound;
+    if (tree_path_leaf_bound(pager, &cursor.path, &bound)) {
+      uint32_t run_end = i + 1;
+      while (run_end < end && sorted[run_end]->id <= bound) {
+        run_end++;
+      }
+      end = run_end;
+    }
+    i += leaf_node_insert_run(&cursor, sorted + i, end - i);
+    inserted += *leaf_node_num_cells(node) - num_cells;
   }
-  uint32_t idx = internal_node_find_child(root,key);
-  for(uint32_t i=idx+1;i<num;i++){
-    memcpy(internal_node_cell(root,i-1),internal_node_cell(root,i),INTERNAL_NODE_CELL_SIZE);
+  for (i = 0; i < num_sorted; i++) {
+    if (sorted[i] != NULL) {
+      index_insert_row(table, sorted[i]);
+    }
+  }
+  free(sorted);
+  return inserted;
+}
+
+// The root never moves: its contents are copied into a fresh page, which
+// becomes the only child of a now empty internal root. The path gains a level
+// at the top. Returns the page the old root contents moved to.
+uint32_t create_new_root(Table* table, TreePath* path) {
+  if (path->depth == TREE_MAX_HEIGHT) {
+    printf("Tree is deeper than %d levels.\n", TREE_MAX_HEIGHT);
+    exit(EXIT_FAILURE);
+  }
+  void* root = get_page(table->pager, table->root_page_num);
+  uint32_t child_page_num = get_unused_page_num(table->pager);
+  void* child = get_page(table->pager, child_page_num);
+
+  memcpy(child, root, table->pager->page_size);
+  set_node_root(child, false);
+
+  initialize_internal_node(root);
+  set_node_root(root, true);
+  *internal_node_right_child(root) = child_page_num;
+  mark_page_dirty(table->pager, root);
+  mark_page_dirty(table->pager, child);
+
+  memmove(path->page_nums + 1, path->page_nums, path->depth * sizeof(uint32_t));
+  memmove(path->child_indexes + 1, path->child_indexes, path->depth * sizeof(uint32_t));
+  path->depth++;
+  path->page_nums[0] = table->root_page_num;
+  path->child_indexes[0] = 0;
+  if (path->depth > 1) {
+    path->page_nums[1] = child_page_num;
   }
-  *internal_node_num_keys(root)-=1;
-}
\ No newline at end of file
+  return child_page_num;
+}
+
+// Called once a merge leaves the root with a single child: the child's
+// contents move up into the root page and the child page is freed.
+void delete_from_root(Table* table) {
+  void* root = get_page(table->pager, table->root_page_num);
+  uint32_t child_page_num = *internal_node_right_child(root);
+  void* child = get_page(table->pager, child_page_num);
+
+  memcpy(root, child, table->pager->page_size);
+  set_node_root(root, true);
+  mark_page_dirty(table->pager, root);
+  delete_page(table->pager, child_page_num);
+}
@@ -0,0 +1,826 @@
+#include "define.h"
+
+// Builds the tree bottom-up from sorted rows instead of inserting them one at
+// a time: leaves are packed to the fill factor in key order, then each
+// internal level is packed over the level below until one node is left.
+// The new tree is written next to the old one and committed in chunks, so a
+// crash part way through leaves the old tree intact (the half-built pages
+// stay allocated). The last commit moves the new top node into the root page
+// and frees the old tree.
+
+// Sort keys are the id in the high half and the row's position in the input
+// in the low half, so rows with the same id stay in input order.
+static int compare_sort_keys(const void* a, const void* b) {
+  uint64_t key_a = *(uint64_t*)a;
+  uint64_t key_b = *(uint64_t*)b;
+  return key_a < key_b ? -1 : key_a > key_b;
+}
+
+// Returns the sort keys of rows in id order; the low half of each is the
+// row's index. The caller frees the keys. Input that is already in order is
+// not sorted again.
+uint64_t* sort_rows_by_id(Row* rows, uint32_t num_rows) {
+  uint64_t* sort_keys = malloc(num_rows * sizeof(uint64_t));
+  bool sorted = true;
+  for (uint32_t i = 0; i < num_rows; i++) {
+    sort_keys[i] = (uint64_t)rows[i].id << 32 | i;
+    if (i > 0 && rows[i - 1].id > rows[i].id) {
+      sorted = false;
+    }
+  }
+  if (!sorted) {
+    qsort(sort_keys, num_rows, sizeof(uint64_t), compare_sort_keys);
+  }
+  return sort_keys;
+}
+
+// Commits the pages written so far every BULK_LOAD_COMMIT_PAGES pages, so the
+// pages of a large load do not all stay pinned until the end. The new pages
+// are mostly adjacent, so flushing them here writes long runs instead of
+// leaving eviction to write them back one at a time.
+static void bulk_load_page_written(Pager* pager, uint32_t* pending) {
+  if (++(*pending) < BULK_LOAD_COMMIT_PAGES) {
+    return;
+  }
+  pager_commit(pager);
+  pager_flush_all(pager);
+  pager_unpin_all(pager);
+  *pending = 0;
+}
+
+// Splits count entries into as few nodes of at most capacity entries as
+// possible, but never so many that a node gets fewer than min_count.
+static uint32_t bulk_load_num_nodes(uint32_t count, uint32_t capacity, uint32_t min_count) {
+  uint32_t num_nodes = (count + capacity - 1) / capacity;
+  if (num_nodes > count / min_count) {
+    num_nodes = count / min_count;
+  }
+  return num_nodes == 0 ? 1 : num_nodes;
+}
+
+// Frees every page below page_num. Nodes at `depth` are leaves and are not
+// read.
+static void bulk_load_free_tree(Pager* pager, uint32_t page_num, uint32_t level,
+                                uint32_t depth) {
+  if (level < depth) {
+    void* node = get_page(pager, page_num);
+    uint32_t num_keys = *internal_node_num_keys(node);
+    for (uint32_t i = 0; i <= num_keys; i++) {
+      bulk_load_free_tree(pager, *internal_node_child(node, i), level + 1, depth);
+    }
+  }
+  if (level > 0) {
+    set_page_used(pager, page_num, false);
+  }
+}
+
+// Packs sorted, unique rows into leaves as they arrive, then builds the
+// internal levels over the leaves. Rows vary in size, so leaves are packed by
+// bytes: each leaf takes an even share of the bytes and rows still to place,
+// over as many leaves as the fill factor calls for, which needs the totals up
+// front. A loader without a pager only measures the rows it is given, so a
+// first pass over the same rows can supply them.
+typedef struct {
+  Pager* pager;
+  uint32_t num_rows;
+  uint64_t num_bytes;
+  uint32_t fill_percent;
+  uint32_t capacity;
+  uint32_t byte_capacity;
+  uint32_t remaining_rows;
+  uint64_t remaining_bytes;
+  uint32_t row_share;
+  uint64_t byte_share;
+  uint32_t page_num;
+  uint32_t prev_page_num;
+  uint32_t cell;
+  uint32_t bytes;
+  uint32_t last_id;
+  uint32_t pending;
+  uint32_t* page_nums;
+  uint32_t* max_keys;
+  uint32_t num_nodes;
+  uint32_t max_nodes;
+} BulkLoader;
+
+// Readies loader, which has measured num_rows and num_bytes, to write them
+// into pager.
+static void bulk_loader_start(BulkLoader* loader, Pager* pager, uint32_t fill_percent) {
+  loader->pager = pager;
+  loader->fill_percent = fill_percent;
+  // The cell cap only binds at the test fan-out.
+  loader->byte_capacity = LEAF_NODE_SPACE_FOR_CELLS(pager) * fill_percent / 100;
+  if (loader->byte_capacity < LEAF_NODE_SPACE_FOR_CELLS(pager) / 2) {
+    loader->byte_capacity = LEAF_NODE_SPACE_FOR_CELLS(pager) / 2;
+  }
+  loader->capacity = LEAF_NODE_MAX_CELLS(pager) * fill_percent / 100;
+  if (loader->capacity < LEAF_NODE_MIN_CELLS(pager)) {
+    loader->capacity = LEAF_NODE_MIN_CELLS(pager);
+  }
+  loader->remaining_rows = loader->num_rows;
+  loader->remaining_bytes = loader->num_bytes;
+  loader->page_num = get_unused_page_num(pager);
+  loader->prev_page_num = INVALID_PAGE_NUM;
+  loader->cell = 0;
+  loader->bytes = 0;
+  loader->pending = 0;
+  loader->num_nodes = 0;
+  loader->max_nodes = loader->num_rows / loader->capacity + 1;
+  loader->page_nums = malloc(loader->max_nodes * sizeof(uint32_t));
+  loader->max_keys = malloc(loader->max_nodes * sizeof(uint32_t));
+}
+
+// Closes the leaf being filled, linking it to next_page_num.
+static void bulk_loader_end_leaf(BulkLoader* loader, uint32_t next_page_num) {
+  Pager* pager = loader->pager;
+  void* node = get_page(pager, loader->page_num);
+  *node_next(node) = next_page_num;
+  mark_page_dirty(pager, node);
+
+  if (loader->num_nodes == loader->max_nodes) {
+    loader->max_nodes *= 2;
+    loader->page_nums = realloc(loader->page_nums, loader->max_nodes * sizeof(uint32_t));
+    loader->max_keys = realloc(loader->max_keys, loader->max_nodes * sizeof(uint32_t));
+  }
+  loader->page_nums[loader->num_nodes] = loader->page_num;
+  loader->max_keys[loader->num_nodes++] = loader->last_id;
+  loader->remaining_bytes -= loader->bytes;
+  bulk_load_page_written(pager, &loader->pending);
+  loader->prev_page_num = loader->page_num;
+  loader->page_num = next_page_num;
+  loader->cell = 0;
+  loader->bytes = 0;
+}
+
+static void bulk_loader_add(BulkLoader* loader, Row* row) {
+  uint32_t size = serialized_row_size(row);
+  if (loader->pager == NULL) {
+    loader->num_rows++;
+    loader->num_bytes += LEAF_NODE_SLOT_SIZE + size;
+    return;
+  }
+  Pager* pager = loader->pager;
+  if (loader->cell > 0 && (loader->cell == loader->row_share ||
+                           loader->bytes + LEAF_NODE_SLOT_SIZE + size > loader->byte_share)) {
+    bulk_loader_end_leaf(loader, get_unused_page_num(pager));
+  }
+
+  void* node = get_page(pager, loader->page_num);
+  if (loader->cell == 0) {
+    uint64_t num_leaves = (loader->remaining_bytes + loader->byte_capacity - 1) /
+                          loader->byte_capacity;
+    if (num_leaves < (loader->remaining_rows + loader->capacity - 1) / loader->capacity) {
+      num_leaves = (loader->remaining_rows + loader->capacity - 1) / loader->capacity;
+    }
+    loader->byte_share = (loader->remaining_bytes + num_leaves - 1) / num_leaves;
+    loader->row_share = (loader->remaining_rows + num_leaves - 1) / num_leaves;
+    initialize_leaf_node(node);
+    *node_prev(node) = loader->prev_page_num;
+  } else {
+    // The leaf stays pinned from its first row until it is written.
+    unpin_page(pager, loader->page_num);
+  }
+  serialize_row(row, leaf_node_insert_cell(pager, node, loader->cell, row->id, size));
+  mark_page_dirty(pager, node);
+  loader->bytes += LEAF_NODE_SLOT_SIZE + size;
+  loader->cell++;
+  loader->remaining_rows--;
+  loader->last_id = row->id;
+}
+
+// Closes the last leaf, packs the internal levels over the leaves and
+// returns the page of the single node at the top.
+static uint32_t bulk_loader_finish(BulkLoader* loader) {
+  Pager* pager = loader->pager;
+  bulk_loader_end_leaf(loader, INVALID_PAGE_NUM);
+  uint32_t* page_nums = loader->page_nums;
+  uint32_t* max_keys = loader->max_keys;
+  uint32_t num_nodes = loader->num_nodes;
+
+  // Each pass packs the nodes of one level under parents, writing the
+  // parents' pages and high keys over the front of the same arrays.
+  uint32_t min_children = INTERNAL_NODE_MIN_KEYS(pager) + 1;
+  uint32_t capacity = (INTERNAL_NODE_MAX_KEYS(pager) + 1) * loader->fill_percent / 100;
+  if (capacity < min_children) {
+    capacity = min_children;
+  }
+  while (num_nodes > 1) {
+    uint32_t num_children = num_nodes;
+    num_nodes = bulk_load_num_nodes(num_children, capacity, min_children);
+    uint32_t child = 0;
+    for (uint32_t i = 0; i < num_nodes; i++) {
+      uint32_t parent_page_num = get_unused_page_num(pager);
+      void* node = get_page(pager, parent_page_num);
+      initialize_internal_node(node);
+
+      uint32_t count = num_children / num_nodes + (i < num_children % num_nodes);
+      for (uint32_t key = 0; key + 1 < count; key++, child++) {
+        *internal_node_cell(node, key) = page_nums[child];
+        *internal_node_key(node, key) = max_keys[child];
+      }
+      *internal_node_num_keys(node) = count - 1;
+      *internal_node_right_child(node) = page_nums[child];
+      mark_page_dirty(pager, node);
+
+      page_nums[i] = parent_page_num;
+      max_keys[i] = max_keys[child++];
+      bulk_load_page_written(pager, &loader->pending);
+    }
+  }
+
+  uint32_t top_page_num = page_nums[0];
+  free(page_nums);
+  free(max_keys);
+  return top_page_num;
+}
+
+// Packs num_rows sorted, unique rows into a new tree and returns the page of
+// the node at the top.
+static uint32_t bulk_load_build(Pager* pager, Row* rows, uint32_t num_rows,
+                                uint32_t fill_percent) {
+  BulkLoader loader = {0};
+  for (uint32_t i = 0; i < num_rows; i++) {
+    bulk_loader_add(&loader, &rows[i]);
+  }
+  bulk_loader_start(&loader, pager, fill_percent);
+  for (uint32_t i = 0; i < num_rows; i++) {
+    bulk_loader_add(&loader, &rows[i]);
+  }
+  return bulk_loader_finish(&loader);
+}
+
+// Frees the table's tree, whose leaves are at depth, and moves the new tree
+// topped by top_page_num into the root page.
+static void bulk_load_replace_tree(Table* table, uint32_t top_page_num, uint32_t depth) {
+  Pager* pager = table->pager;
+  bulk_load_free_tree(pager, table->root_page_num, 0, depth);
+  void* root = get_page(pager, table->root_page_num);
+  void* top = get_page(pager, top_page_num);
+  memcpy(root, top, pager->page_size);
+  set_node_root(root, true);
+  mark_page_dirty(pager, root);
+  set_page_used(pager, top_page_num, false);
+  table->tree_version++;
+}
+
+// Feeds loader the table's rows merged, in id order, with the input rows in
+// sort_keys order. An input row is skipped when the table or an earlier input
+// row already has its id, as insert would; the rows taken are listed in added
+// when it is not NULL. The table is read a leaf at a time, and each leaf is
+// copied out before the loader sees it, as the loader's commits unpin the
+// table's pages. The pages the loader wrote are left for the caller to
+// commit before anything unpins them. Returns the number of input rows taken,
+// and sets the number of leaves the table's rows were in and the depth of
+// those leaves.
+static uint32_t bulk_load_merge(Table* table, Row* rows, uint64_t* sort_keys, uint32_t num_rows,
+                                BulkLoader* loader, Row** added, uint32_t* num_leaves,
+                                uint32_t* depth) {
+  Row* existing = malloc(ROW_BATCH_MAX_ROWS * sizeof(Row));
+  uint32_t num_added = 0;
+  uint32_t next = 0;
+  int64_t last_id = -1;
+  *num_leaves = 0;
+  Cursor cursor;
+  RowBatch batch;
+  table_start(table, &cursor);
+  *depth = cursor.path.depth;
+  while (true) {
+    uint32_t count = 0;
+    if (cursor_next_batch(&cursor, &batch)) {
+      count = batch.count;
+      for (uint32_t i = 0; i < count; i++) {
+        deserialize_row(batch.values[i], &existing[i]);
+      }
+      (*num_leaves)++;
+    }
+    for (uint32_t e = 0; e <= count; e++) {
+      // Input rows go in ahead of each row of the table below them, and once
+      // the table is done, all that are left.
+      int64_t bound = e < count ? existing[e].id : count == 0 ? INT64_MAX : 0;
+      while (next < num_rows) {
+        Row* row = &rows[(uint32_t)sort_keys[next]];
+        if (row->id >= bound) {
+          break;
+        }
+        next++;
+        if (row->id == last_id) {
+          continue;
+        }
+        bulk_loader_add(loader, row);
+        if (added != NULL) {
+          added[num_added] = row;
+        }
+        num_added++;
+        last_id = row->id;
+      }
+      if (e < count) {
+        bulk_loader_add(loader, &existing[e]);
+        last_id = existing[e].id;
+      }
+    }
+    if (count == 0) {
+      break;
+    }
+  }
+  free(existing);
+  return num_added;
+}
+
+// Loads rows into the table, merged with the rows it already holds. When an
+// id repeats, the row already in the table wins, as with insert, and after
+// that the earliest row in the input. fill_percent sets how full leaves and
+// internal nodes are packed. Returns the number of rows added.
+uint32_t table_bulk_load(Table* table, Row* rows, uint32_t num_rows, uint32_t fill_percent) {
+  Pager* pager = table->pager;
+  uint64_t* sort_keys = sort_rows_by_id(rows, num_rows);
+
+  // The rows already in the table are merged in, so the result is one new
+  // tree. They are streamed past twice, once to measure and once to build,
+  // so no more than a leaf of them is held at a time.
+  BulkLoader loader = {0};
+  uint32_t num_leaves;
+  uint32_t depth;
+  uint32_t added = bulk_load_merge(table, rows, sort_keys, num_rows, &loader, NULL, &num_leaves,
+                                   &depth);
+  if (added > 0) {
+    Row** added_rows = malloc(added * sizeof(Row*));
+    bulk_loader_start(&loader, pager, fill_percent);
+    bulk_load_merge(table, rows, sort_keys, num_rows, &loader, added_rows, &num_leaves, &depth);
+    uint32_t top_page_num = bulk_loader_finish(&loader);
+    bulk_load_replace_tree(table, top_page_num, depth);
+    // The rows from the input are indexed in the commit that swaps the trees.
+    for (uint32_t i = 0; i < added; i++) {
+      index_insert_row(table, added_rows[i]);
+    }
+    free(added_rows);
+  }
+  pager_commit(pager);
+  pager_unpin_all(pager);
+  free(sort_keys);
+  return added;
+}
+
+// Rebuilds the tree from its own rows, packed to fill_percent, which undoes
+// the sparse leaves that lazy deletes leave behind. Like a bulk load, the new
+// tree is written beside the old one and swapped in by the last commit, and
+// the rows pass through a leaf at a time.
+void table_compact(Table* table, uint32_t fill_percent) {
+  Pager* pager = table->pager;
+  uint64_t start = now_us();
+  // The rows are streamed from the old leaves into the new ones, after a
+  // first pass that measures them.
+  BulkLoader loader = {0};
+  uint32_t num_leaves;
+  uint32_t depth;
+  bulk_load_merge(table, NULL, NULL, 0, &loader, NULL, &num_leaves, &depth);
+  if (depth == 0) {
+    printf("Table fits in one leaf; nothing to compact.\n");
+    pager_unpin_all(pager);
+    return;
+  }
+
+  uint32_t num_rows = loader.num_rows;
+  bulk_loader_start(&loader, pager, fill_percent);
+  bulk_load_merge(table, NULL, NULL, 0, &loader, NULL, &num_leaves, &depth);
+  uint32_t top_page_num = bulk_loader_finish(&loader);
+  bulk_load_replace_tree(table, top_page_num, depth);
+  pager_commit(pager);
+  pager_unpin_all(pager);
+
+  uint32_t new_num_leaves = 0;
+  Cursor cursor;
+  RowBatch batch;
+  table_start(table, &cursor);
+  while (cursor_next_batch(&cursor, &batch)) {
+    new_num_leaves++;
+  }
+  pager_unpin_all(pager);
+  printf("Compacted %d rows from %d leaves into %d in %.1f ms.\n", num_rows, num_leaves,
+         new_num_leaves, (now_us() - start) / 1000.0);
+}
+
+// Packs keys that arrive in order into key tree leaves, as the BulkLoader
+// does for the table: leaves are packed to the fill factor, each leaf
+// boundary gets the shortest separator that divides the two leaves, and each
+// internal level is packed over the one below with the separators between
+// its nodes moving up.
+typedef struct {
+  Pager* pager;
+  uint32_t fill_percent;
+  uint32_t capacity;
+  uint32_t byte_capacity;
+  uint32_t page_num;
+  uint32_t prev_page_num;
+  uint32_t num_cells;
+  uint8_t last[INDEX_KEY_MAX_SIZE];
+  uint32_t last_length;
+  uint32_t pending;
+  uint32_t* page_nums;
+  uint8_t** separators;
+  uint32_t* separator_lengths;
+  uint32_t num_nodes;
+  uint32_t max_nodes;
+} IndexLoader;
+
+static void index_loader_start(IndexLoader* loader, Pager* pager, uint32_t fill_percent) {
+  loader->pager = pager;
+  loader->fill_percent = fill_percent;
+  loader->byte_capacity = KEY_NODE_SPACE_FOR_CELLS(pager) * fill_percent / 100;
+  if (loader->byte_capacity < KEY_NODE_SPACE_FOR_CELLS(pager) / 2) {
+    loader->byte_capacity = KEY_NODE_SPACE_FOR_CELLS(pager) / 2;
+  }
+  loader->capacity = LEAF_NODE_MAX_CELLS(pager) * fill_percent / 100;
+  if (loader->capacity < (LEAF_NODE_MAX_CELLS(pager) + 1) / 2) {
+    loader->capacity = (LEAF_NODE_MAX_CELLS(pager) + 1) / 2;
+  }
+  loader->page_num = INVALID_PAGE_NUM;
+  loader->prev_page_num = INVALID_PAGE_NUM;
+  loader->num_cells = 0;
+  loader->last_length = 0;
+  loader->pending = 0;
+  loader->num_nodes = 0;
+  loader->max_nodes = 64;
+  loader->page_nums = malloc(loader->max_nodes * sizeof(uint32_t));
+  loader->separators = malloc(loader->max_nodes * sizeof(uint8_t*));
+  loader->separator_lengths = malloc(loader->max_nodes * sizeof(uint32_t));
+}
+
+static void index_loader_end_leaf(IndexLoader* loader, uint32_t next_page_num) {
+  Pager* pager = loader->pager;
+  void* node = get_page(pager, loader->page_num);
+  key_node_fit_prefix(node);
+  *node_next(node) = next_page_num;
+  mark_page_dirty(pager, node);
+
+  if (loader->num_nodes == loader->max_nodes) {
+    loader->max_nodes *= 2;
+    loader->page_nums = realloc(loader->page_nums, loader->max_nodes * sizeof(uint32_t));
+    loader->separators = realloc(loader->separators, loader->max_nodes * sizeof(uint8_t*));
+    loader->separator_lengths =
+        realloc(loader->separator_lengths, loader->max_nodes * sizeof(uint32_t));
+  }
+  loader->page_nums[loader->num_nodes++] = loader->page_num;
+  bulk_load_page_written(pager, &loader->pending);
+  loader->prev_page_num = loader->page_num;
+  loader->page_num = next_page_num;
+  loader->num_cells = 0;
+}
+
+static void index_loader_add(IndexLoader* loader, const uint8_t* key, uint32_t length,
+                             uint32_t value) {
+  Pager* pager = loader->pager;
+  if (loader->num_cells > 0) {
+    void* node = get_page(pager, loader->page_num);
+    unpin_page(pager, loader->page_num);
+    if (loader->num_cells == loader->capacity || !key_node_has_room(pager, node, length) ||
+        key_node_used_bytes(node) + KEY_NODE_SLOT_SIZE + KEY_NODE_RECORD_HEADER_SIZE + length >
+            loader->byte_capacity) {
+      index_loader_end_leaf(loader, get_unused_page_num(pager));
+    }
+  }
+  if (loader->page_num == INVALID_PAGE_NUM) {
+    loader->page_num = get_unused_page_num(pager);
+  }
+
+  void* node = get_page(pager, loader->page_num);
+  if (loader->num_cells == 0) {
+    initialize_key_node(node, NODE_LEAF);
+    *node_prev(node) = loader->prev_page_num;
+    if (loader->num_nodes > 0) {
+      uint32_t separator_length = key_separator_length(loader->last, loader->last_length, key,
+                                                       length);
+      loader->separators[loader->num_nodes - 1] = malloc(separator_length);
+      memcpy(loader->separators[loader->num_nodes - 1], key, separator_length);
+      loader->separator_lengths[loader->num_nodes - 1] = separator_length;
+    }
+  } else {
+    // The leaf stays pinned from its first key until it is written.
+    unpin_page(pager, loader->page_num);
+  }
+  key_node_insert_cell(pager, node, loader->num_cells++, key, length, value);
+  mark_page_dirty(pager, node);
+  memcpy(loader->last, key, length);
+  loader->last_length = length;
+}
+
+// Closes the last leaf, packs the internal levels and returns the root page.
+static uint32_t index_loader_finish(IndexLoader* loader) {
+  Pager* pager = loader->pager;
+  if (loader->page_num == INVALID_PAGE_NUM) {
+    free(loader->page_nums);
+    free(loader->separators);
+    free(loader->separator_lengths);
+    return key_tree_create(pager);
+  }
+  index_loader_end_leaf(loader, INVALID_PAGE_NUM);
+  uint32_t* page_nums = loader->page_nums;
+  uint8_t** separators = loader->separators;
+  uint32_t* separator_lengths = loader->separator_lengths;
+  uint32_t num_nodes = loader->num_nodes;
+
+  // Each pass packs one level under parents, writing the parents' pages and
+  // the separators between them over the front of the same arrays. A node
+  // past the fill factor still takes the last child, so no parent is left
+  // with a single child.
+  uint32_t capacity = INTERNAL_NODE_MAX_KEYS(pager) * loader->fill_percent / 100;
+  if (capacity < (INTERNAL_NODE_MAX_KEYS(pager) + 1) / 2) {
+    capacity = (INTERNAL_NODE_MAX_KEYS(pager) + 1) / 2;
+  }
+  while (num_nodes > 1) {
+    uint32_t num_children = num_nodes;
+    uint32_t child = 0;
+    num_nodes = 0;
+    while (child < num_children) {
+      uint32_t parent_page_num = get_unused_page_num(pager);
+      void* node = get_page(pager, parent_page_num);
+      initialize_key_node(node, NODE_INTERNAL);
+      uint32_t right_child = page_nums[child++];
+      while (child < num_children) {
+        uint32_t length = separator_lengths[child - 1];
+        uint32_t num_cells = *key_node_num_cells(node);
+        bool full = num_cells == capacity ||
+                    key_node_used_bytes(node) + KEY_NODE_SLOT_SIZE +
+                            KEY_NODE_RECORD_HEADER_SIZE + length > loader->byte_capacity;
+        if (!key_node_has_room(pager, node, length) || (full && child + 1 < num_children)) {
+          break;
+        }
+        key_node_insert_cell(pager, node, num_cells, separators[child - 1], length, right_child);
+        free(separators[child - 1]);
+        right_child = page_nums[child++];
+      }
+      *key_node_right_child(node) = right_child;
+      key_node_fit_prefix(node);
+      mark_page_dirty(pager, node);
+
+      page_nums[num_nodes] = parent_page_num;
+      if (child < num_children) {
+        separators[num_nodes] = separators[child - 1];
+        separator_lengths[num_nodes] = separator_lengths[child - 1];
+      }
+      num_nodes++;
+      bulk_load_page_written(pager, &loader->pending);
+    }
+  }
+
+  uint32_t root_page_num = page_nums[0];
+  void* root = get_page(pager, root_page_num);
+  set_node_root(root, true);
+  mark_page_dirty(pager, root);
+  free(page_nums);
+  free(separators);
+  free(separator_lengths);
+  return root_page_num;
+}
+
+// Copies column's index from the table into pager, reading the old tree's
+// keys in order.
+static uint32_t bulk_load_copy_index(Table* table, IndexColumn column, Pager* pager,
+                                     uint32_t fill_percent) {
+  IndexLoader loader;
+  index_loader_start(&loader, pager, fill_percent);
+  KeyCursor cursor;
+  key_tree_seek(table->pager, table->index_root_page_nums[column], (const uint8_t*)"", 0,
+                &cursor);
+  while (!cursor.end_of_tree) {
+    uint32_t length;
+    uint8_t* key = key_cursor_key(&cursor, &length);
+    index_loader_add(&loader, key, length, key_cursor_value(&cursor));
+    key_cursor_advance(&cursor);
+  }
+  pager_unpin_all(table->pager);
+  return index_loader_finish(&loader);
+}
+
+// Times a full scan of the table with nothing cached, in milliseconds.
+static double vacuum_cold_scan_ms(Table* table) {
+  pager_drop_cache(table->pager);
+  uint64_t start = now_us();
+  Cursor cursor;
+  RowBatch batch;
+  table_start(table, &cursor);
+  while (cursor_next_batch(&cursor, &batch)) {
+  }
+  pager_unpin_all(table->pager);
+  return (now_us() - start) / 1000.0;
+}
+
+static off_t vacuum_file_size(const char* filename) {
+  struct stat file_stat;
+  if (stat(filename, &file_stat) == -1) {
+    printf("Unable to stat %s: %d\n", filename, errno);
+    exit(EXIT_FAILURE);
+  }
+  return file_stat.st_size;
+}
+
+// Makes a rename in filename's directory durable; the entry is part of the
+// directory, so fsyncing the file alone does not cover it.
+static void vacuum_sync_directory(const char* filename) {
+  char* path = strdup(filename);
+  int fd = open(dirname(path), O_RDONLY);
+  if (fd == -1 || fsync(fd) == -1) {
+    printf("Unable to sync the directory of %s: %d\n", filename, errno);
+    exit(EXIT_FAILURE);
+  }
+  close(fd);
+  free(path);
+}
+
+// Rewrites the table and its indexes into a new file and swaps it in. Over
+// time the lowest-free-page allocator scatters logically adjacent leaves
+// across the file, and freed pages are never returned to the file system;
+// the new file holds the table's leaves first, in key order and packed to
+// fill_percent, then its internal nodes, then each index the same way, and
+// nothing else. Rows and keys are streamed from the old trees a leaf at a
+// time. The new file is written as <filename>-vacuum without a log: nothing
+// reads it until the rename, which is the commit point. It is fsynced before
+// the rename and the directory after it, so a crash leaves either the old
+// file or the new one.
+void table_vacuum(Table* table, uint32_t fill_percent) {
+  Pager* pager = table->pager;
+  uint64_t start = now_us();
+  pager_checkpoint(pager);
+  off_t size_before = vacuum_file_size(table->filename);
+  double scan_before = vacuum_cold_scan_ms(table);
+
+  BulkLoader loader = {0};
+  uint32_t num_leaves;
+  uint32_t depth;
+  bulk_load_merge(table, NULL, NULL, 0, &loader, NULL, &num_leaves, &depth);
+  uint32_t num_rows = loader.num_rows;
+
+  char* vacuum_filename = malloc(strlen(table->filename) + 8);
+  strcpy(vacuum_filename, table->filename);
+  strcat(vacuum_filename, "-vacuum");
+  unlink(vacuum_filename);
+  DbOptions options = table->options;
+  options.backend = PAGER_BUFFERED;
+  options.wal_mode = WAL_OFF;
+  options.page_size = pager->page_size;
+  Pager* new_pager = pager_open(vacuum_filename, &options);
+  new_pager->leaf_max_cells = pager->leaf_max_cells;
+  new_pager->internal_max_keys = pager->internal_max_keys;
+  write_page_format(new_pager);
+
+  uint32_t root_page_num;
+  if (num_rows > 0) {
+    bulk_loader_start(&loader, new_pager, fill_percent);
+    bulk_load_merge(table, NULL, NULL, 0, &loader, NULL, &num_leaves, &depth);
+    root_page_num = bulk_loader_finish(&loader);
+  } else {
+    root_page_num = get_unused_page_num(new_pager);
+    initialize_leaf_node(get_page(new_pager, root_page_num));
+  }
+  void* root = get_page(new_pager, root_page_num);
+  set_node_root(root, true);
+  mark_page_dirty(new_pager, root);
+  *table_root(new_pager) = root_page_num;
+  for (IndexColumn column = 0; column < NUM_INDEXES; column++) {
+    *index_root(new_pager, column) = bulk_load_copy_index(table, column, new_pager, fill_percent);
+  }
+  write_page_format(new_pager);
+  // Closing checkpoints, which writes every page and fsyncs the file.
+  pager_close(new_pager);
+
+  pager_close(pager);
+  if (rename(vacuum_filename, table->filename) == -1) {
+    printf("Unable to replace %s: %d\n", table->filename, errno);
+    exit(EXIT_FAILURE);
+  }
+  vacuum_sync_directory(table->filename);
+  free(vacuum_filename);
+  off_t size_after = vacuum_file_size(table->filename);
+
+  table->pager = pager_open(table->filename, &table->options);
+  table->root_page_num = *table_root(table->pager);
+  table->rightmost_page_num = INVALID_PAGE_NUM;
+  table->tree_version++;
+  table_build_indexes(table);
+  double scan_after = vacuum_cold_scan_ms(table);
+  printf("Vacuumed %d rows in %.1f ms: file %lld -> %lld bytes, cold scan %.1f -> %.1f ms.\n",
+         num_rows, (now_us() - start) / 1000.0, (long long)size_before, (long long)size_after,
+         scan_before, scan_after);
+}
+
+// Rewrites a tree from before version 4, whose rows were fixed width, in the
+// current leaf layout. Leaves from before version 3 also interleaved keys and
+// rows. The rows are read off the old leaf chain and packed into a new tree
+// beside the old one, as a bulk load does; the new version is recorded in the
+// same commit that swaps the trees.
+void table_upgrade_leaves(Table* table) {
+  Pager* pager = table->pager;
+  uint32_t depth = 0;
+  uint32_t page_num = table->root_page_num;
+  void* node = get_page(pager, page_num);
+  while (get_node_type(node) == NODE_INTERNAL) {
+    unpin_page(pager, page_num);
+    page_num = *internal_node_child(node, 0);
+    node = get_page(pager, page_num);
+    depth++;
+  }
+
+  Row* rows = NULL;
+  uint32_t num_rows = 0;
+  uint32_t capacity = 0;
+  while (true) {
+    uint32_t num_cells = *leaf_node_num_cells(node);
+    if (num_rows + num_cells > capacity) {
+      capacity = (num_rows + num_cells) * 2;
+      rows = realloc(rows, capacity * sizeof(Row));
+    }
+    for (uint32_t i = 0; i < num_cells; i++) {
+      void* value;
+      if (pager->leaf_version < 3) {
+        value = node + LEAF_NODE_HEADER_SIZE + i * LEGACY_LEAF_NODE_CELL_SIZE + LEAF_NODE_KEY_SIZE;
+      } else {
+        value = leaf_node_value(node, i);
+      }
+      deserialize_fixed_row(value, &rows[num_rows++]);
+    }
+    uint32_t next_page_num = *node_next(node);
+    unpin_page(pager, page_num);
+    if (next_page_num == INVALID_PAGE_NUM) {
+      break;
+    }
+    page_num = next_page_num;
+    node = get_page(pager, page_num);
+  }
+
+  // Fixed width rows capped the fan-out well below what a leaf now holds.
+  if (pager->leaf_max_cells != TEST_FANOUT) {
+    pager->leaf_max_cells = LEAF_NODE_SPACE_FOR_CELLS(pager) / LEAF_NODE_MIN_CELL_SIZE;
+  }
+  if (num_rows > 0) {
+    uint32_t top_page_num = bulk_load_build(pager, rows, num_rows, 100);
+    bulk_load_replace_tree(table, top_page_num, depth);
+  } else {
+    void* root = get_page(pager, table->root_page_num);
+    initialize_leaf_node(root);
+    set_node_root(root, true);
+    mark_page_dirty(pager, root);
+  }
+  pager->leaf_version = DB_VERSION;
+  write_page_format(pager);
+  pager_commit(pager);
+  pager_unpin_all(pager);
+  free(rows);
+  printf("Upgraded %d rows to the variable length row layout.\n", num_rows);
+}
+
+// Reads "id,username,email" lines and bulk loads them. Lines that do not
+// parse, or whose fields are too long for a row, are counted and skipped.
+// Returns the number of rows added, or -1 if the file cannot be opened.
+int64_t load_csv(Table* table, const char* filename, uint32_t fill_percent) {
+  FILE* file = fopen(filename, "r");
+  if (file == NULL) {
+    return -1;
+  }
+
+  Row* rows = NULL;
+  uint32_t num_rows = 0;
+  uint32_t capacity = 0;
+  uint32_t skipped = 0;
+  char* line = NULL;
+  size_t line_capacity = 0;
+  ssize_t length;
+  while ((length = getline(&line, &line_capacity, file)) != -1) {
+    while (length > 0 && (line[length - 1] == '\n' || line[length - 1] == '\r')) {
+      line[--length] = '\0';
+    }
+    if (length == 0) {
+      continue;
+    }
+    char* id_string = strtok(line, ",");
+    char* username = strtok(NULL, ",");
+    char* email = strtok(NULL, ",");
+    char* end = NULL;
+    long long id = id_string == NULL ? -1 : strtoll(id_string, &end, 10);
+    if (username == NULL || email == NULL || strtok(NULL, ",") != NULL ||
+        *end != '\0' || id < 0 || id > INT32_MAX ||
+        strlen(username) > COLUMN_USERNAME_SIZE || strlen(email) > COLUMN_EMAIL_SIZE) {
+      skipped++;
+      continue;
+    }
+
+    if (num_rows == capacity) {
+      capacity = capacity == 0 ? 1024 : capacity * 2;
+      rows = realloc(rows, capacity * sizeof(Row));
+    }
+    Row* row = &rows[num_rows++];
+    row->id = id;
+    strcpy(row->username, username);
+    strcpy(row->email, email);
+  }
+  free(line);
+  fclose(file);
+
+  if (skipped > 0) {
+    printf("Skipped %d malformed lines.\n", skipped);
+  }
+  uint32_t added = table_bulk_load(table, rows, num_rows, fill_percent);
+  if (added < num_rows) {
+    printf("Skipped %d rows with duplicate ids.\n", num_rows - added);
+  }
+  free(rows);
+  return added;
+}
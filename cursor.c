@@ -1,35 +1,172 @@
 #include "define.h"
 
-Cursor* table_start(Table* table) {
-  Cursor* cursor = table_find(table, 0);
+// Called each time a scan steps onto a new leaf. Once half of the leaves read
+// ahead have been consumed, the next readahead_window leaves are prefetched
+// as one batch and the window doubles, up to the pager's read-ahead limit.
+// readahead_path follows the last leaf prefetched, so the leaves to fetch are
+// read off their parents without reading any leaf.
+static void cursor_readahead(Cursor* cursor) {
+  Pager* pager = cursor->table->pager;
+  if (cursor->readahead_window == 0) {
+    return;
+  }
+  if (cursor->readahead_ahead > 0) {
+    cursor->readahead_ahead--;
+  }
+  if (cursor->readahead_ahead > cursor->readahead_window / 2) {
+    return;
+  }
+
+  uint32_t* page_nums = malloc(cursor->readahead_window * sizeof(uint32_t));
+  uint32_t count = 0;
+  while (count < cursor->readahead_window) {
+    uint32_t page_num = tree_path_next_leaf(pager, &cursor->readahead_path);
+    if (page_num == INVALID_PAGE_NUM) {
+      break;
+    }
+    page_nums[count++] = page_num;
+  }
+  if (count > 0) {
+    pager_prefetch(pager, page_nums, count);
+    cursor->readahead_ahead += count;
+  }
+  free(page_nums);
+
+  if (cursor->readahead_window * 2 <= pager->readahead_max) {
+    cursor->readahead_window *= 2;
+  }
+}
+
+void table_start(Table* table, Cursor* cursor) {
+  table_find(table, 0, cursor);
 
   void* node = get_page(table->pager, cursor->page_num);
   uint32_t num_cells = *leaf_node_num_cells(node);
   cursor->end_of_table = (num_cells == 0);
 
-  return cursor;
+  if (table->pager->readahead_max > 0) {
+    cursor->readahead_window = READAHEAD_MIN_PAGES;
+    if (cursor->readahead_window > table->pager->readahead_max) {
+      cursor->readahead_window = table->pager->readahead_max;
+    }
+    cursor->readahead_path = cursor->path;
+    cursor_readahead(cursor);
+  }
+}
+
+// Positions the cursor on the first row whose key is at least key, to scan
+// forward from there with cursor_advance().
+void table_seek(Table* table, uint32_t key, Cursor* cursor) {
+  table_find(table, key, cursor);
+  void* node = get_page(table->pager, cursor->page_num);
+  unpin_page(table->pager, cursor->page_num);
+  uint32_t num_cells = *leaf_node_num_cells(node);
+  cursor->end_of_table = (num_cells == 0);
+  if (num_cells > 0 && cursor->cell_num == num_cells) {
+    // Every key in this leaf is smaller; the first row is in the next leaf.
+    cursor->cell_num = num_cells - 1;
+    cursor_advance(cursor);
+  }
+}
+
+// Positions the cursor on the last row whose key is at most key, to scan
+// backward from there with cursor_retreat().
+void table_seek_last(Table* table, uint32_t key, Cursor* cursor) {
+  table_find(table, key, cursor);
+  void* node = get_page(table->pager, cursor->page_num);
+  unpin_page(table->pager, cursor->page_num);
+  cursor->end_of_table = false;
+  if (cursor->cell_num < *leaf_node_num_cells(node) &&
+      *leaf_node_key(node, cursor->cell_num) == key) {
+    return;
+  }
+  cursor_retreat(cursor);
 }
 
+// The cursor keeps one pin on the leaf it is positioned on, taken when the
+// leaf was first fetched, so lookups here do not add pins of their own.
 void* cursor_value(Cursor* cursor) {
   uint32_t page_num = cursor->page_num;
   void* page = get_page(cursor->table->pager, page_num);
+  unpin_page(cursor->table->pager, page_num);
   return leaf_node_value(page, cursor->cell_num);
 }
 
+uint32_t cursor_key(Cursor* cursor) {
+  uint32_t page_num = cursor->page_num;
+  void* page = get_page(cursor->table->pager, page_num);
+  unpin_page(cursor->table->pager, page_num);
+  return *leaf_node_key(page, cursor->cell_num);
+}
+
+// Moves the cursor from the leaf node, which it has finished, onto the first
+// row of the next leaf, or sets end_of_table after the last leaf.
+static void cursor_next_leaf(Cursor* cursor, void* node) {
+  uint32_t next_page_num = *node_next(node);
+  if (next_page_num == INVALID_PAGE_NUM) {
+    cursor->end_of_table = true;
+    return;
+  }
+  unpin_page(cursor->table->pager, cursor->page_num);
+  get_page(cursor->table->pager, next_page_num);
+  cursor->page_num = next_page_num;
+  cursor->cell_num = 0;
+  cursor_readahead(cursor);
+}
+
 void cursor_advance(Cursor* cursor) {
   uint32_t page_num = cursor->page_num;
   void* node = get_page(cursor->table->pager, page_num);
+  unpin_page(cursor->table->pager, page_num);
 
   cursor->cell_num += 1;
   if (cursor->cell_num >= (*leaf_node_num_cells(node))) {
-  
-    uint32_t next_page_num = *node_next(node);
-    if (next_page_num == INVALID_PAGE_NUM) {
-     
-      cursor->end_of_table = true;
-    } else {
-      cursor->page_num = next_page_num;
-      cursor->cell_num = 0;
+    cursor_next_leaf(cursor, node);
+  }
+}
+
+// Hands out the rest of the cursor's leaf in one go: the keys, and pointers
+// to the values inside the page, so a scan touches the pager once per leaf
+// rather than once per row. The pointers stay valid until the next call,
+// which moves on to the next leaf. Returns false once the table is done.
+bool cursor_next_batch(Cursor* cursor, RowBatch* batch) {
+  batch->count = 0;
+  while (!cursor->end_of_table && batch->count == 0) {
+    void* node = get_page(cursor->table->pager, cursor->page_num);
+    unpin_page(cursor->table->pager, cursor->page_num);
+    uint32_t num_cells = *leaf_node_num_cells(node);
+    if (cursor->cell_num >= num_cells) {
+      cursor_next_leaf(cursor, node);
+      continue;
+    }
+    for (uint32_t i = cursor->cell_num; i < num_cells; i++) {
+      batch->keys[batch->count] = *leaf_node_key(node, i);
+      batch->values[batch->count] = leaf_node_value(node, i);
+      batch->count++;
     }
+    cursor->cell_num = num_cells;
+  }
+  return batch->count > 0;
+}
+
+// Steps back one row, following node_prev onto the previous leaf. Sets
+// end_of_table once it steps back past the first row.
+void cursor_retreat(Cursor* cursor) {
+  if (cursor->cell_num > 0) {
+    cursor->cell_num -= 1;
+    return;
   }
-}
\ No newline at end of file
+  uint32_t page_num = cursor->page_num;
+  void* node = get_page(cursor->table->pager, page_num);
+  unpin_page(cursor->table->pager, page_num);
+
+  uint32_t prev_page_num = *node_prev(node);
+  if (prev_page_num == INVALID_PAGE_NUM) {
+    cursor->end_of_table = true;
+    return;
+  }
+  unpin_page(cursor->table->pager, page_num);
+  void* prev_node = get_page(cursor->table->pager, prev_page_num);
+  cursor->page_num = prev_page_num;
+  cursor->cell_num = *leaf_node_num_cells(prev_node) - 1;
+}
@@ -1,11 +1,18 @@
 #include "define.h"
 #include "btree.c"
+#include "bulk_load.c"
 #include "cursor.c"
+#include "index.c"
 #include "internal_node.c" 
+#include "io_engine.c"
+#include "key_node.c"
+#include "key_search.c"
+#include "key_tree.c"
 #include "leaf_node.c" 
 #include "pager.c" 
 #include "query_processing.c" 
 #include "test.c"
+#include "wal.c"
 int main(int argc, char* argv[]) {
   if (argc < 2) {
     printf("Must supply a database filename.\n");
@@ -13,11 +20,20 @@ int main(int argc, char* argv[]) {
   }
 
   char* filename = argv[1];
-  Table* table = db_open(filename);
+  DbOptions options;
+  default_db_options(&options);
+  for (int i = 2; i < argc; i++) {
+    if (!parse_db_option(&options, argv[i])) {
+      printf("Unrecognized option '%s'\n", argv[i]);
+      exit(EXIT_FAILURE);
+    }
+  }
+  Table* table = db_open(filename, &options);
 
   InputBuffer* input_buffer = new_input_buffer();
   while (true) {
     print_prompt();
+    pager_wait_for_input(table->pager);
     read_input(input_buffer);
 
     if (input_buffer->buffer[0] == '.') {
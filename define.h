@@ -3,6 +3,8 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <libgen.h>
+#include <poll.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -10,6 +12,28 @@
 #include <string.h>
 #include <unistd.h>
 #include <sys/stat.h>
+#include <sys/uio.h>
+#include <time.h>
+
+// The io_uring engine and the mmap backend are only built where their
+// headers exist. Elsewhere --io=uring falls back to pread/pwrite and
+// --backend=mmap is rejected.
+#if defined(__has_include)
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING
+#endif
+#if __has_include(<sys/mman.h>)
+#define HAVE_MMAP
+#endif
+#endif
+
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#endif
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
 
 typedef struct {
   char* buffer;
@@ -36,7 +60,7 @@ typedef enum {
   PREPARE_UNRECOGNIZED_STATEMENT
 } PrepareResult;
 
-typedef enum { STATEMENT_INSERT, STATEMENT_SELECT, STATEMENT_DELETE, STATEMENT_SELECT_ONE, STATEMENT_UPDATE } StatementType;
+typedef enum { STATEMENT_INSERT, STATEMENT_SELECT, STATEMENT_DELETE, STATEMENT_SELECT_ONE, STATEMENT_UPDATE, STATEMENT_INSERT_BATCH, STATEMENT_SELECT_RANGE, STATEMENT_SELECT_INDEX } StatementType;
 
 #define COLUMN_USERNAME_SIZE 32
 #define COLUMN_EMAIL_SIZE 255
@@ -46,10 +70,20 @@ typedef struct {
   char email[COLUMN_EMAIL_SIZE + 1];
 } Row;
 
+// Columns with a secondary index, in the order their roots follow the
+// table's in the page 0 header.
+typedef enum { INDEX_USERNAME, INDEX_EMAIL, NUM_INDEXES } IndexColumn;
+
 typedef struct {
   StatementType type;
   Row row;  
   uint32_t old_id; 
+  Row* rows;
+  uint32_t num_rows;
+  uint32_t range_hi;
+  uint32_t limit;
+  bool descending;
+  IndexColumn index_column;
 } Statement;
 
 #define size_of_attribute(Struct, Attribute) sizeof(((Struct*)0)->Attribute)
@@ -57,28 +91,232 @@ typedef struct {
 #define ID_SIZE size_of_attribute(Row, id)
 #define USERNAME_SIZE size_of_attribute(Row, username)
 #define EMAIL_SIZE size_of_attribute(Row, email)
+// Serialized row: id | username length | username | email length | email.
+// The strings are stored without padding or terminator, so a row takes
+// between ROW_MIN_SIZE and ROW_MAX_SIZE bytes.
+#define ROW_LENGTH_SIZE sizeof(uint8_t)
+#define ROW_MIN_SIZE (ID_SIZE + 2 * ROW_LENGTH_SIZE)
+#define ROW_MAX_SIZE (ROW_MIN_SIZE + COLUMN_USERNAME_SIZE + COLUMN_EMAIL_SIZE)
+// Rows written before version 4 were the Row struct's fields at fixed width.
 #define ID_OFFSET 0
 #define USERNAME_OFFSET (ID_OFFSET + ID_SIZE)
 #define EMAIL_OFFSET (USERNAME_OFFSET + USERNAME_SIZE)
 #define ROW_SIZE (ID_SIZE + USERNAME_SIZE + EMAIL_SIZE)
 
-#define PAGE_SIZE 4096
-#define TABLE_MAX_PAGES (PAGE_SIZE - sizeof(uint32_t))
-#define PAGE_USED_OFFSET sizeof(uint32_t)
-#define PAGE_USED_SIZE 1
+// The page size is chosen when a db file is created and read back from its
+// header; files from before the header recorded it use DEFAULT_PAGE_SIZE.
+#define DEFAULT_PAGE_SIZE 4096
+#define MIN_PAGE_SIZE 4096
+#define MAX_PAGE_SIZE 65536
+// Node fan-out used by --test-fanout, and by every file written before the
+// header recorded fan-out.
+#define TEST_FANOUT 3
+// Page numbers below DB_MAX_PAGES are valid; UINT32_MAX is INVALID_PAGE_NUM.
+#define DB_MAX_PAGES UINT32_MAX
+
+// Page 0 header: root page | magic | version | page size | leaf max cells |
+// internal max keys | index roots | free map of the first extent. Every PAGES_PER_EXTENT
+// pages the first page of the extent holds the free map (one bit per page)
+// of that extent at the same offset.
+#define HEADER_ROOT_OFFSET 0
+#define HEADER_MAGIC_OFFSET 4
+#define HEADER_VERSION_OFFSET 8
+#define HEADER_PAGE_SIZE_OFFSET 12
+#define HEADER_LEAF_MAX_CELLS_OFFSET 16
+#define HEADER_INTERNAL_MAX_KEYS_OFFSET 20
+#define HEADER_INDEX_ROOTS_OFFSET 24
+#define FREE_MAP_OFFSET 64
+#define FREE_MAP_WORDS(pager) (((pager)->page_size - FREE_MAP_OFFSET) / sizeof(uint64_t))
+#define PAGES_PER_EXTENT(pager) (FREE_MAP_WORDS(pager) * 64)
+#define DB_MAGIC 0x7a2db0f1
+#define DB_VERSION 5
+// First version with the current leaf layout.
+#define LEAF_LAYOUT_VERSION 4
 
 #define INVALID_PAGE_NUM UINT32_MAX
+#define INVALID_FRAME_NUM UINT32_MAX
+#define DEFAULT_POOL_FRAMES 256
+#define MIN_POOL_FRAMES 8
+
+typedef enum { WAL_OFF, WAL_SYNC, WAL_GROUP } WalMode;
+typedef enum { PAGER_BUFFERED, PAGER_MMAP } PagerBackend;
+typedef enum { IO_ENGINE_SYNC, IO_ENGINE_URING } IoEngineType;
+
+#define DEFAULT_GROUP_COMMIT_SIZE 32
+#define DEFAULT_GROUP_COMMIT_MS 10
+#define DEFAULT_CHECKPOINT_PAGES 1000
+
+typedef struct {
+  PagerBackend backend;
+  IoEngineType io_engine;
+  uint32_t pool_frames;
+  uint32_t readahead_pages;
+  WalMode wal_mode;
+  uint32_t group_commit_size;
+  uint32_t group_commit_ms;
+  uint32_t checkpoint_pages;
+  uint32_t page_size;
+  bool test_fanout;
+  bool lazy_deletes;
+} DbOptions;
+
+#define WAL_MAGIC 0x314c4157
+#define WAL_HEADER_SIZE (2 * sizeof(uint32_t))
+#define WAL_FRAME_HEADER_SIZE (4 * sizeof(uint32_t))
+#define WAL_FRAME_SIZE(page_size) (WAL_FRAME_HEADER_SIZE + (page_size))
+
+typedef struct {
+  int file_descriptor;
+  uint32_t page_size;
+  WalMode mode;
+  uint32_t group_commit_size;
+  uint32_t group_commit_ms;
+  uint32_t checkpoint_pages;
+  uint32_t num_frames;
+  uint32_t pending_commits;
+  uint64_t first_pending_us;
+  void* buffer;
+  uint32_t buffer_frames;
+  uint64_t opened_us;
+  uint64_t commits;
+  uint64_t fsyncs;
+  uint64_t checkpoints;
+  uint64_t total_commit_us;
+  uint64_t max_commit_us;
+} Wal;
+
+typedef struct {
+  uint32_t page_num;
+  uint32_t pin_count;
+  bool dirty;
+  bool uncommitted;
+  bool referenced;
+  void* data;
+} Frame;
+
+#define MMAP_GROW_PAGES 256
+#define MMAP_MIN_RESERVE_PAGES (1 << 18)
+#define PAGE_TABLE_MIN_CAPACITY 64
+#define FLUSH_MAX_RUN_PAGES 256
+#define IO_URING_ENTRIES 64
+#define PREFETCH_BATCH_PAGES 64
+#define READAHEAD_MIN_PAGES 4
+#define DEFAULT_READAHEAD_PAGES 64
+#define BENCH_INSERT_ROWS 10000
+#define BENCH_SEARCH_LOOKUPS 1000000
+#define BENCH_KEYS_COUNT 100000
+#define BENCH_KEYS_STRIDE 32
+#define BULK_LOAD_COMMIT_PAGES 256
+#define BULK_LOAD_FILL_PERCENT 90
+
+typedef struct {
+  bool write;
+  off_t offset;
+  struct iovec* iov;
+  uint32_t iov_count;
+} IoRequest;
+
+typedef struct {
+  IoEngineType type;
+  int ring_fd;
+  uint32_t sq_entries;
+  void* sq_ring;
+  size_t sq_ring_size;
+  uint32_t* sq_tail;
+  uint32_t* sq_mask;
+  uint32_t* sq_array;
+  struct io_uring_sqe* sqes;
+  size_t sqes_size;
+  void* cq_ring;
+  size_t cq_ring_size;
+  uint32_t* cq_head;
+  uint32_t* cq_tail;
+  uint32_t* cq_mask;
+  struct io_uring_cqe* cqes;
+  uint64_t batches;
+  uint64_t requests;
+  uint64_t syscalls;
+} IoEngine;
+
+// Sparse map from page number to frame: open addressing with linear probing,
+// kept at most half full. Empty slots hold INVALID_PAGE_NUM.
+typedef struct {
+  uint32_t* page_nums;
+  uint32_t* frame_nums;
+  uint32_t capacity;
+  uint32_t shift;
+  uint32_t count;
+} PageTable;
 
 typedef struct {
   int file_descriptor;
-  uint32_t file_length;
-  void* pages[TABLE_MAX_PAGES];
+  off_t file_length;
+  uint32_t page_size;
+  uint32_t leaf_max_cells;
+  uint32_t internal_max_keys;
+  // Version of the file the leaves were written in. Leaves from before
+  // LEAF_LAYOUT_VERSION are rewritten by table_upgrade_leaves() when the
+  // table is opened.
+  uint32_t leaf_version;
+  PagerBackend backend;
+  void* map;
+  uint32_t mapped_pages;
+  uint64_t map_reserved_pages;
+  bool* map_dirty;
+  IoEngine io;
   void* page_used;
+  bool header_dirty;
+  bool header_uncommitted;
+  Wal* wal;
+  Frame* frames;
+  void* frame_memory;
+  uint32_t num_frames;
+  uint32_t max_frames;
+  uint32_t frames_capacity;
+  uint32_t clock_hand;
+  uint32_t readahead_max;
+  uint32_t num_pages;
+  uint32_t free_hint;
+  PageTable page_table;
+  uint64_t hits;
+  uint64_t misses;
+  uint64_t evictions;
+  uint64_t writebacks;
+  uint64_t pages_written;
+  uint64_t write_calls;
+  uint64_t prefetched;
 } Pager;
 
+// Internal nodes have at least two children, so a tree over 2^32 pages is
+// never deeper than this.
+#define TREE_MAX_HEIGHT 32
+
+// The internal nodes passed on the way from the root to a leaf, root first,
+// with the child index taken in each. The leaf is the child taken at level
+// depth - 1, or the root itself when depth is 0.
+typedef struct {
+  uint32_t depth;
+  uint32_t page_nums[TREE_MAX_HEIGHT];
+  uint32_t child_indexes[TREE_MAX_HEIGHT];
+} TreePath;
+
 typedef struct {
   Pager* pager;
   uint32_t root_page_num;
+  // Path to the rightmost leaf, kept from the last descent that ended there.
+  // It is only used while rightmost_version matches tree_version, which
+  // every split, rebalance and bulk load bumps.
+  TreePath rightmost_path;
+  uint32_t rightmost_page_num;
+  uint32_t rightmost_version;
+  uint32_t tree_version;
+  uint32_t index_root_page_nums[NUM_INDEXES];
+  // Leaves are only merged once empty, and internal nodes once down to one
+  // child; table_compact() packs what they leave behind.
+  bool lazy_deletes;
+  // What the file was opened with, so table_vacuum() can reopen it.
+  char* filename;
+  DbOptions options;
 } Table;
 
 typedef struct {
@@ -86,9 +324,20 @@ typedef struct {
   uint32_t page_num;
   uint32_t cell_num;
   bool end_of_table; 
+  TreePath path;
+  uint32_t readahead_window;
+  uint32_t readahead_ahead;
+  TreePath readahead_path;
 } Cursor;
 
 
+typedef struct {
+  Pager* pager;
+  uint32_t page_num;
+  uint32_t cell_num;
+  bool end_of_tree;
+} KeyCursor;
+
 typedef enum { NODE_INTERNAL, NODE_LEAF } NodeType;
 
 #define NODE_TYPE_SIZE sizeof(uint8_t)
@@ -112,31 +361,72 @@ typedef enum { NODE_INTERNAL, NODE_LEAF } NodeType;
 #define INTERNAL_NODE_KEY_SIZE sizeof(uint32_t)
 #define INTERNAL_NODE_CHILD_SIZE sizeof(uint32_t)
 #define INTERNAL_NODE_CELL_SIZE (INTERNAL_NODE_CHILD_SIZE + INTERNAL_NODE_KEY_SIZE)
-#define INTERNAL_NODE_MAX_KEYS 3 // Kept this small for testing
-#define INTERNAL_NODE_MIN_KEYS ((INTERNAL_NODE_MAX_KEYS+1)/2 -1)
+#define INTERNAL_NODE_SPACE_FOR_CELLS(pager) ((pager)->page_size - INTERNAL_NODE_HEADER_SIZE)
+#define INTERNAL_NODE_MAX_KEYS(pager) ((pager)->internal_max_keys)
+#define INTERNAL_NODE_MIN_KEYS(pager) ((INTERNAL_NODE_MAX_KEYS(pager)+1)/2 -1)
 
 #define LEAF_NODE_NUM_CELLS_SIZE sizeof(uint32_t)
 #define LEAF_NODE_NUM_CELLS_OFFSET COMMON_NODE_HEADER_SIZE
-#define LEAF_NODE_NEXT_LEAF_SIZE sizeof(uint32_t)
-#define LEAF_NODE_NEXT_LEAF_OFFSET (LEAF_NODE_NUM_CELLS_OFFSET + LEAF_NODE_NUM_CELLS_SIZE)
-#define LEAF_NODE_HEADER_SIZE (COMMON_NODE_HEADER_SIZE + LEAF_NODE_NUM_CELLS_SIZE + LEAF_NODE_NEXT_LEAF_SIZE)
-
-
-
+#define LEAF_NODE_HEAP_SIZE_SIZE sizeof(uint32_t)
+#define LEAF_NODE_HEAP_SIZE_OFFSET (LEAF_NODE_NUM_CELLS_OFFSET + LEAF_NODE_NUM_CELLS_SIZE)
+#define LEAF_NODE_HEADER_SIZE (COMMON_NODE_HEADER_SIZE + LEAF_NODE_NUM_CELLS_SIZE + LEAF_NODE_HEAP_SIZE_SIZE)
+
+// Leaf layout: header | slots | free space | heap. Slots are sorted by key and
+// hold (value offset, key), the same shape as internal node cells, so the
+// keys can be searched without touching the rows. Values are serialized rows
+// packed at the end of the page, growing down; heap size is the bytes they
+// take up, so the free space is whatever the slots and heap leave over.
+// Leaves fill up by bytes; max cells only caps the count, which is how
+// --test-fanout keeps trees small.
 #define LEAF_NODE_KEY_SIZE sizeof(uint32_t)
-#define LEAF_NODE_KEY_OFFSET 0
-#define LEAF_NODE_VALUE_SIZE ROW_SIZE
-#define LEAF_NODE_VALUE_OFFSET (LEAF_NODE_KEY_OFFSET + LEAF_NODE_KEY_SIZE)
-#define LEAF_NODE_CELL_SIZE (LEAF_NODE_KEY_SIZE + LEAF_NODE_VALUE_SIZE)
-#define LEAF_NODE_SPACE_FOR_CELLS (PAGE_SIZE - LEAF_NODE_HEADER_SIZE)
-// #define LEAF_NODE_MAX_CELLS (LEAF_NODE_SPACE_FOR_CELLS / LEAF_NODE_CELL_SIZE)
-#define LEAF_NODE_MAX_CELLS 3
-#define LEAF_NODE_MIN_CELLS ((LEAF_NODE_MAX_CELLS+1)/2)
-#define LEAF_NODE_RIGHT_SPLIT_COUNT ((LEAF_NODE_MAX_CELLS + 1) / 2)
-#define LEAF_NODE_LEFT_SPLIT_COUNT ((LEAF_NODE_MAX_CELLS + 1) - LEAF_NODE_RIGHT_SPLIT_COUNT)
+#define LEAF_NODE_OFFSET_SIZE sizeof(uint32_t)
+#define LEAF_NODE_SLOT_SIZE (LEAF_NODE_OFFSET_SIZE + LEAF_NODE_KEY_SIZE)
+#define LEAF_NODE_MIN_CELL_SIZE (LEAF_NODE_SLOT_SIZE + ROW_MIN_SIZE)
+#define LEAF_NODE_MAX_CELL_SIZE (LEAF_NODE_SLOT_SIZE + ROW_MAX_SIZE)
+// Leaves written before version 3 interleaved key | row cells; version 3
+// leaves were slotted but held fixed width rows.
+#define LEGACY_LEAF_NODE_CELL_SIZE (LEAF_NODE_KEY_SIZE + ROW_SIZE)
+#define FIXED_LEAF_NODE_CELL_SIZE (LEAF_NODE_SLOT_SIZE + ROW_SIZE)
+#define LEAF_NODE_SPACE_FOR_CELLS(pager) ((pager)->page_size - LEAF_NODE_HEADER_SIZE)
+#define LEAF_NODE_MAX_CELLS(pager) ((pager)->leaf_max_cells)
+#define LEAF_NODE_MIN_CELLS(pager) ((LEAF_NODE_MAX_CELLS(pager)+1)/2)
+
+// Nodes of the trees keyed by byte strings (key_node.c) share one layout:
+// header | slots | free space | heap. Slots hold (record offset, key head);
+// records are payload | key length | key. The prefix length is how many
+// leading bytes every key in the node shares; heads are read after it.
+#define KEY_NODE_NUM_CELLS_OFFSET COMMON_NODE_HEADER_SIZE
+#define KEY_NODE_HEAP_SIZE_OFFSET (KEY_NODE_NUM_CELLS_OFFSET + sizeof(uint32_t))
+#define KEY_NODE_RIGHT_CHILD_OFFSET (KEY_NODE_HEAP_SIZE_OFFSET + sizeof(uint32_t))
+#define KEY_NODE_PREFIX_LENGTH_OFFSET (KEY_NODE_RIGHT_CHILD_OFFSET + sizeof(uint32_t))
+#define KEY_NODE_HEADER_SIZE (KEY_NODE_PREFIX_LENGTH_OFFSET + sizeof(uint32_t))
+#define KEY_NODE_OFFSET_SIZE sizeof(uint32_t)
+#define KEY_HEAD_SIZE sizeof(uint32_t)
+#define KEY_NODE_SLOT_SIZE (KEY_NODE_OFFSET_SIZE + KEY_HEAD_SIZE)
+#define KEY_NODE_PAYLOAD_SIZE sizeof(uint32_t)
+#define KEY_NODE_LENGTH_SIZE sizeof(uint16_t)
+#define KEY_NODE_RECORD_HEADER_SIZE (KEY_NODE_PAYLOAD_SIZE + KEY_NODE_LENGTH_SIZE)
+#define KEY_NODE_SPACE_FOR_CELLS(pager) ((pager)->page_size - KEY_NODE_HEADER_SIZE)
+// Small enough that a split of a full node always leaves room on both sides.
+#define KEY_MAX_SIZE 512
+// Column value, its zero byte and the id.
+#define INDEX_KEY_MAX_SIZE (COLUMN_EMAIL_SIZE + 1 + ID_SIZE)
+
+// Most rows a leaf can hold at any page size.
+#define ROW_BATCH_MAX_ROWS ((MAX_PAGE_SIZE - LEAF_NODE_HEADER_SIZE) / LEAF_NODE_MIN_CELL_SIZE)
+
+// The rows of one leaf, as handed out by cursor_next_batch(). values point
+// straight into the leaf's page, which stays pinned until the next call.
+typedef struct {
+  uint32_t count;
+  uint32_t keys[ROW_BATCH_MAX_ROWS];
+  void* values[ROW_BATCH_MAX_ROWS];
+} RowBatch;
 
 // query_processing.c
-Table* db_open(const char* filename);
+void default_db_options(DbOptions* options);
+bool parse_db_option(DbOptions* options, const char* arg);
+Table* db_open(const char* filename, DbOptions* options);
 InputBuffer* new_input_buffer();
 void print_prompt();
 void read_input(InputBuffer* input_buffer);
@@ -146,24 +436,132 @@ MetaCommandResult do_meta_command(InputBuffer* input_buffer, Table* table);
 PrepareResult prepare_insert(InputBuffer* input_buffer, Statement* statement);
 PrepareResult prepare_statement(InputBuffer* input_buffer, Statement* statement);
 ExecuteResult execute_insert(Statement* statement, Table* table);
+ExecuteResult execute_insert_batch(Statement* statement, Table* table);
 ExecuteResult execute_select(Statement* statement, Table* table);
+ExecuteResult execute_select_range(Statement* statement, Table* table);
+ExecuteResult execute_select_index(Statement* statement, Table* table);
 ExecuteResult execute_statement(Statement* statement, Table* table);
 
 //pager.c
-Pager* pager_open(const char* filename);
+Pager* pager_open(const char* filename, DbOptions* options);
+void write_page_format(Pager* pager);
 void* get_page(Pager* pager, uint32_t page_num);
+void unpin_page(Pager* pager, uint32_t page_num);
+void mark_page_dirty(Pager* pager, void* page);
+void pager_unpin_all(Pager* pager);
+uint32_t pager_evict_frame(Pager* pager);
 void pager_flush(Pager* pager, uint32_t page_num);
-bool* is_page_used(Pager* pager, uint32_t page_num);
+uint32_t pager_flush_all(Pager* pager);
+uint32_t pager_prefetch(Pager* pager, uint32_t* page_nums, uint32_t count);
+void pager_drop_cache(Pager* pager);
+void pager_wait_for_input(Pager* pager);
+void pager_commit(Pager* pager);
+uint32_t pager_checkpoint(Pager* pager);
+void pager_close(Pager* pager);
+void print_pager_stats(Pager* pager);
+bool is_page_used(Pager* pager, uint32_t page_num);
+void set_page_used(Pager* pager, uint32_t page_num, bool used);
 uint32_t * table_root(Pager * pager);
 uint32_t get_unused_page_num(Pager* pager);
 void delete_page(Pager* pager, uint32_t page_num);
-void serialize_row(Row* source, void* destination);
+uint32_t serialized_row_size(Row* row);
+uint32_t serialized_value_size(void* value);
+uint32_t serialize_row(Row* source, void* destination);
 void deserialize_row(void* source, Row* destination);
+void deserialize_fixed_row(void* source, Row* destination);
+
+//bulk_load.c
+uint64_t* sort_rows_by_id(Row* rows, uint32_t num_rows);
+uint32_t table_bulk_load(Table* table, Row* rows, uint32_t num_rows, uint32_t fill_percent);
+void table_compact(Table* table, uint32_t fill_percent);
+void table_vacuum(Table* table, uint32_t fill_percent);
+void table_upgrade_leaves(Table* table);
+int64_t load_csv(Table* table, const char* filename, uint32_t fill_percent);
+
+//wal.c
+uint64_t now_us();
+uint32_t wal_recover(const char* db_filename, int db_fd);
+Wal* wal_open(const char* db_filename, DbOptions* options, uint32_t page_size);
+void wal_append(Wal* wal, uint32_t* page_nums, void** pages, uint32_t count);
+void wal_sync(Wal* wal);
+int wal_sync_timeout_ms(Wal* wal);
+void wal_reset(Wal* wal);
+void wal_close(Wal* wal);
+void print_wal_stats(Wal* wal);
+
+//io_engine.c
+void io_engine_open(IoEngine* engine, IoEngineType type);
+void io_engine_close(IoEngine* engine);
+void io_engine_submit(IoEngine* engine, int fd, IoRequest* requests, uint32_t count);
+const char* io_engine_name(IoEngine* engine);
+
+//key_search.c
+uint32_t key_search(const void* cells, uint32_t count, uint32_t key);
+
+//key_node.c
+int key_compare(const uint8_t* a, uint32_t a_length, const uint8_t* b, uint32_t b_length);
+uint32_t key_common_prefix(const uint8_t* a, uint32_t a_length, const uint8_t* b,
+                           uint32_t b_length);
+uint32_t key_head(const uint8_t* key, uint32_t length, uint32_t offset);
+uint32_t key_separator_length(const uint8_t* left, uint32_t left_length,
+                              const uint8_t* right, uint32_t right_length);
+void key_encode_uint32(uint32_t value, uint8_t* key);
+void key_encode_uint64(uint64_t value, uint8_t* key);
+uint32_t* key_node_num_cells(void* node);
+uint32_t* key_node_heap_size(void* node);
+uint32_t* key_node_right_child(void* node);
+uint32_t* key_node_prefix_length(void* node);
+uint32_t* key_node_slot(void* node, uint32_t cell_num);
+uint32_t* key_node_head(void* node, uint32_t cell_num);
+uint32_t* key_node_payload(void* node, uint32_t cell_num);
+uint32_t key_node_key_length(void* node, uint32_t cell_num);
+uint8_t* key_node_key(void* node, uint32_t cell_num);
+uint32_t key_node_child(void* node, uint32_t index);
+void key_node_set_child(void* node, uint32_t index, uint32_t page_num);
+void initialize_key_node(void* node, NodeType type);
+uint32_t key_node_used_bytes(void* node);
+bool key_node_has_room(Pager* pager, void* node, uint32_t length);
+void key_node_fit_prefix(void* node);
+void key_node_insert_cell(Pager* pager, void* node, uint32_t cell_num, const uint8_t* key,
+                          uint32_t length, uint32_t payload);
+void key_node_remove_cell(Pager* pager, void* node, uint32_t cell_num);
+uint32_t key_node_find(void* node, const uint8_t* key, uint32_t length, bool* found);
+uint32_t key_node_find_child(void* node, const uint8_t* key, uint32_t length);
+uint32_t key_node_split_point(void* node);
+void key_node_split(Pager* pager, void* node, void* right, uint32_t split);
+
+//key_tree.c
+uint32_t key_tree_create(Pager* pager);
+bool key_tree_insert(Pager* pager, uint32_t root_page_num, const uint8_t* key, uint32_t length,
+                     uint32_t value);
+bool key_tree_delete(Pager* pager, uint32_t root_page_num, const uint8_t* key,
+                     uint32_t length);
+void key_tree_free(Pager* pager, uint32_t page_num);
+void key_tree_seek(Pager* pager, uint32_t root_page_num, const uint8_t* key, uint32_t length,
+                   KeyCursor* cursor);
+uint8_t* key_cursor_key(KeyCursor* cursor, uint32_t* length);
+uint32_t key_cursor_value(KeyCursor* cursor);
+void key_cursor_advance(KeyCursor* cursor);
+
+//index.c
+uint32_t* index_root(Pager* pager, IndexColumn column);
+uint32_t index_key(IndexColumn column, Row* row, uint8_t* key);
+void index_insert_row(Table* table, Row* row);
+void index_delete_row(Table* table, Row* row);
+void index_update_row(Table* table, Row* old_row, Row* new_row);
+void index_seek(Table* table, IndexColumn column, Row* value, KeyCursor* cursor);
+bool index_cursor_matches(KeyCursor* cursor, IndexColumn column, Row* value);
+void table_build_indexes(Table* table);
 
 //cursor.c
-Cursor* table_start(Table* table);
+void table_start(Table* table, Cursor* cursor);
+void table_seek(Table* table, uint32_t key, Cursor* cursor);
+void table_seek_last(Table* table, uint32_t key, Cursor* cursor);
 void* cursor_value(Cursor* cursor);
+uint32_t cursor_key(Cursor* cursor);
 void cursor_advance(Cursor* cursor);
+void cursor_retreat(Cursor* cursor);
+bool cursor_next_batch(Cursor* cursor, RowBatch* batch);
 
 // internal_node.c
 uint32_t* internal_node_num_keys(void* node);
@@ -173,27 +571,42 @@ uint32_t* internal_node_child(void* node, uint32_t child_num);
 uint32_t* internal_node_key(void* node, uint32_t key_num);
 void initialize_internal_node(void* node);
 uint32_t internal_node_find_child(void* node, uint32_t key);
-Cursor* internal_node_find(Table* table, uint32_t page_num, uint32_t key);
-void internal_node_split_and_insert(Table* table, uint32_t parent_page_num, uint32_t child_page_num);
-void internal_node_insert(Table* table, uint32_t parent_page_num, uint32_t child_page_num);
-void update_internal_node_key(void* node, uint32_t old_key, uint32_t new_key);
-void borrow_from_left_internal(Pager* pager, void* node, void * left, void* par);
-void borrow_from_right_internal(Pager * pager, void* node, void * right, void * par);
-void merge_internal(void* node, void* left, void* par, Table* table );
-void delete_from_internal(Table* table,uint32_t node_page_num, uint32_t key);
+void internal_node_split_and_insert(Table* table, TreePath* path, uint32_t level,
+                                    uint32_t left_max, uint32_t right_page_num, bool append);
+void internal_node_insert(Table* table, TreePath* path, uint32_t level,
+                          uint32_t left_max, uint32_t right_page_num, bool append);
+void borrow_from_left_internal(Pager* pager, void* node, void* left, void* parent,
+                               uint32_t index);
+void borrow_from_right_internal(Pager* pager, void* node, void* right, void* parent,
+                                uint32_t index);
+void merge_internal(Table* table, TreePath* path, uint32_t level, void* left, void* right,
+                    uint32_t index);
+void delete_from_internal(Table* table, TreePath* path, uint32_t level, uint32_t index);
 
 //leaf_node.c
 uint32_t* leaf_node_num_cells(void* node);
-void* leaf_node_cell(void* node, uint32_t cell_num);
+uint32_t* leaf_node_heap_size(void* node);
+uint32_t* leaf_node_slot(void* node, uint32_t cell_num);
 uint32_t* leaf_node_key(void* node, uint32_t cell_num);
 void* leaf_node_value(void* node, uint32_t cell_num);
 void initialize_leaf_node(void* node);
-Cursor* leaf_node_find(Table* table, uint32_t page_num, uint32_t key);
+uint32_t leaf_node_used_bytes(void* node);
+bool leaf_node_has_room(Pager* pager, void* node, uint32_t value_size);
+void* leaf_node_insert_cell(Pager* pager, void* node, uint32_t cell_num, uint32_t key,
+                            uint32_t value_size);
+void leaf_node_remove_cells(Pager* pager, void* node, uint32_t cell_num, uint32_t count);
+void leaf_node_move_cells(Pager* pager, void* destination, uint32_t destination_cell,
+                          void* source, uint32_t source_cell, uint32_t count);
+void leaf_node_find(Table* table, uint32_t page_num, uint32_t key, Cursor* cursor);
 void leaf_node_split_and_insert(Cursor* cursor, uint32_t key, Row* value);
 void leaf_node_insert(Cursor* cursor, uint32_t key, Row* value);
-void borrow_from_right_leaf(void * node, void* right, void* par);
-void borrow_from_left_leaf(void * node, void* left,void* par);
-void merge_leaf(void* node, void* left,void* par, Table* table);
+bool leaf_node_update(Cursor* cursor, uint32_t new_cell_num, Row* value);
+uint32_t leaf_node_insert_run(Cursor* cursor, Row** run, uint32_t count);
+void borrow_from_right_leaf(Pager* pager, void* node, void* right, void* parent,
+                            uint32_t index);
+void borrow_from_left_leaf(Pager* pager, void* node, void* left, void* parent,
+                           uint32_t index);
+void merge_leaf(Table* table, TreePath* path, void* left, void* right, uint32_t index);
 void delete_from_leaf(Cursor* cursor);
 
 //btree.c
@@ -203,16 +616,23 @@ bool is_node_root(void* node);
 void set_node_root(void* node, bool is_root);
 uint32_t* node_next(void* node);
 uint32_t* node_prev(void* node);
-uint32_t* node_parent(void* node);
-uint32_t get_node_max_key(Pager* pager, void* node);
-Cursor* table_find(Table* table, uint32_t key);
-void create_new_root(Table* table, uint32_t right_child_page_num);
-void delete_from_root(Table* table, uint32_t key);
+void table_find(Table* table, uint32_t key, Cursor* cursor);
+bool table_get_row(Table* table, uint32_t key, Row* row);
+uint32_t table_insert_batch(Table* table, Row* rows, uint32_t num_rows);
+uint32_t tree_path_next_leaf(Pager* pager, TreePath* path);
+uint32_t create_new_root(Table* table, TreePath* path);
+void delete_from_root(Table* table);
 
 //test.c
-void print_constants();
+void print_constants(Pager* pager);
 void indent(uint32_t level);
 void print_row(Row* row);
+void print_row_value(void* value);
 void print_tree(Pager* pager, uint32_t page_num, uint32_t indentation_level);
+void bench_scan(Table* table);
+void bench_readahead(Table* table);
+void bench_insert(Table* table);
+void bench_search(Table* table);
+void bench_keys(Table* table);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,132 @@
+#include "define.h"
+
+// Secondary indexes on username and email. Each is a key tree in the same
+// file, its root recorded in page 0 after the table's. A key is the column
+// value, a zero byte and the row's id big-endian, with the id stored under
+// it: rows sharing a value get distinct keys, listed in id order, and every
+// key for a value starts with the same value and zero byte.
+
+uint32_t* index_root(Pager* pager, IndexColumn column) {
+  return pager->page_used + HEADER_INDEX_ROOTS_OFFSET + column * sizeof(uint32_t);
+}
+
+// Writes the index key for row into key and returns its length. The value
+// alone, with its zero byte, is the first length - ID_SIZE bytes.
+uint32_t index_key(IndexColumn column, Row* row, uint8_t* key) {
+  const char* value = column == INDEX_USERNAME ? row->username : row->email;
+  uint32_t value_length = strlen(value) + 1;
+  memcpy(key, value, value_length);
+  key_encode_uint32(row->id, key + value_length);
+  return value_length + ID_SIZE;
+}
+
+void index_insert_row(Table* table, Row* row) {
+  uint8_t key[INDEX_KEY_MAX_SIZE];
+  for (IndexColumn column = 0; column < NUM_INDEXES; column++) {
+    uint32_t length = index_key(column, row, key);
+    key_tree_insert(table->pager, table->index_root_page_nums[column], key, length, row->id);
+  }
+}
+
+void index_delete_row(Table* table, Row* row) {
+  uint8_t key[INDEX_KEY_MAX_SIZE];
+  for (IndexColumn column = 0; column < NUM_INDEXES; column++) {
+    uint32_t length = index_key(column, row, key);
+    key_tree_delete(table->pager, table->index_root_page_nums[column], key, length);
+  }
+}
+
+// Moves the row's entries for an update from old_row to new_row. Columns
+// whose key is unchanged, same value and same id, are left alone.
+void index_update_row(Table* table, Row* old_row, Row* new_row) {
+  uint8_t old_key[INDEX_KEY_MAX_SIZE];
+  uint8_t new_key[INDEX_KEY_MAX_SIZE];
+  for (IndexColumn column = 0; column < NUM_INDEXES; column++) {
+    uint32_t old_length = index_key(column, old_row, old_key);
+    uint32_t new_length = index_key(column, new_row, new_key);
+    if (key_compare(old_key, old_length, new_key, new_length) == 0) {
+      continue;
+    }
+    key_tree_delete(table->pager, table->index_root_page_nums[column], old_key, old_length);
+    key_tree_insert(table->pager, table->index_root_page_nums[column], new_key, new_length,
+                    new_row->id);
+  }
+}
+
+// Positions cursor on the first key of column's index whose value is value.
+// The keys for value follow until index_cursor_matches() fails.
+void index_seek(Table* table, IndexColumn column, Row* value, KeyCursor* cursor) {
+  uint8_t key[INDEX_KEY_MAX_SIZE];
+  uint32_t length = index_key(column, value, key);
+  key_tree_seek(table->pager, table->index_root_page_nums[column], key, length - ID_SIZE,
+                cursor);
+}
+
+bool index_cursor_matches(KeyCursor* cursor, IndexColumn column, Row* value) {
+  if (cursor->end_of_tree) {
+    return false;
+  }
+  uint8_t key[INDEX_KEY_MAX_SIZE];
+  uint32_t length = index_key(column, value, key);
+  uint32_t found_length;
+  uint8_t* found = key_cursor_key(cursor, &found_length);
+  return found_length == length && memcmp(found, key, length - ID_SIZE) == 0;
+}
+
+// Builds the indexes a file does not have yet: files from before version 5,
+// and new files. The trees are filled from a scan of the table, committed a
+// leaf of rows at a time, and their roots only written to the header in the
+// last commit, so a crash part way through leaves the file without them
+// (the half-built pages stay allocated) and the next open starts over.
+void table_build_indexes(Table* table) {
+  Pager* pager = table->pager;
+  bool missing[NUM_INDEXES];
+  bool any_missing = false;
+  for (IndexColumn column = 0; column < NUM_INDEXES; column++) {
+    table->index_root_page_nums[column] = *index_root(pager, column);
+    missing[column] = table->index_root_page_nums[column] == 0;
+    if (missing[column]) {
+      table->index_root_page_nums[column] = key_tree_create(pager);
+      any_missing = true;
+    }
+  }
+  if (!any_missing) {
+    return;
+  }
+
+  Row* rows = malloc(ROW_BATCH_MAX_ROWS * sizeof(Row));
+  uint8_t key[INDEX_KEY_MAX_SIZE];
+  uint32_t num_rows = 0;
+  Cursor cursor;
+  RowBatch batch;
+  table_start(table, &cursor);
+  while (cursor_next_batch(&cursor, &batch)) {
+    // The batch points into the leaf, which may be evicted once the index
+    // pages are read, so the rows are copied out first.
+    for (uint32_t i = 0; i < batch.count; i++) {
+      deserialize_row(batch.values[i], &rows[i]);
+    }
+    for (uint32_t i = 0; i < batch.count; i++) {
+      for (IndexColumn column = 0; column < NUM_INDEXES; column++) {
+        if (missing[column]) {
+          uint32_t length = index_key(column, &rows[i], key);
+          key_tree_insert(pager, table->index_root_page_nums[column], key, length, rows[i].id);
+        }
+      }
+    }
+    num_rows += batch.count;
+    pager_commit(pager);
+    pager_unpin_all(pager);
+  }
+  free(rows);
+
+  for (IndexColumn column = 0; column < NUM_INDEXES; column++) {
+    *index_root(pager, column) = table->index_root_page_nums[column];
+  }
+  write_page_format(pager);
+  pager_commit(pager);
+  pager_unpin_all(pager);
+  if (num_rows > 0) {
+    printf("Indexed %d rows by username and email.\n", num_rows);
+  }
+}
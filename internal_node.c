@@ -51,314 +51,189 @@ void initialize_internal_node(void* node) {
   *internal_node_right_child(node) = INVALID_PAGE_NUM;
 }
 
+// Returns the index of the child that covers key: the first whose key is at
+// least key, or the right child.
 uint32_t internal_node_find_child(void* node, uint32_t key) {
- 
-
-  uint32_t num_keys = *internal_node_num_keys(node);
-
-  uint32_t min_index = 0;
-  uint32_t max_index = num_keys; 
-
-  while (min_index != max_index) {
-    uint32_t index = (min_index + max_index) / 2;
-    uint32_t key_to_right = *internal_node_key(node, index);
-    if (key_to_right >= key) {
-      max_index = index;
-    } else {
-      min_index = index + 1;
-    }
-  }
-
-  return min_index;
+  return key_search(internal_node_cell(node, 0), *internal_node_num_keys(node), key);
 }
 
-Cursor* internal_node_find(Table* table, uint32_t page_num, uint32_t key) {
-  void* node = get_page(table->pager, page_num);
-
-  uint32_t child_index = internal_node_find_child(node, key);
-  uint32_t child_num = *internal_node_child(node, child_index);
-  void* child = get_page(table->pager, child_num);
-  switch (get_node_type(child)) {
-    case NODE_LEAF:
-      return leaf_node_find(table, child_num, key);
-    case NODE_INTERNAL:
-      return internal_node_find(table, child_num, key);
-  }
+// Records in node that child index split: the child keeps the keys up to
+// left_max and right_page_num, holding the rest, becomes child index + 1.
+static void internal_node_insert_cell(void* node, uint32_t index, uint32_t left_max,
+                                      uint32_t right_page_num) {
+  uint32_t num_keys = *internal_node_num_keys(node);
+  uint32_t left_page_num = *internal_node_child(node, index);
+  memmove(internal_node_cell(node, index + 1), internal_node_cell(node, index),
+          (num_keys - index) * INTERNAL_NODE_CELL_SIZE);
+  *internal_node_num_keys(node) = num_keys + 1;
+  *internal_node_cell(node, index) = left_page_num;
+  *internal_node_key(node, index) = left_max;
+  *internal_node_child(node, index + 1) = right_page_num;
 }
 
-
-void internal_node_insert(Table* table, uint32_t parent_page_num,
-                          uint32_t child_page_num) {
-  
-
-  void* parent = get_page(table->pager, parent_page_num);
-  void* child = get_page(table->pager, child_page_num);
-  uint32_t child_max_key = get_node_max_key(table->pager, child);
-  uint32_t index = internal_node_find_child(parent, child_max_key);
-
-  uint32_t original_num_keys = *internal_node_num_keys(parent);
-
-  if (original_num_keys >= INTERNAL_NODE_MAX_KEYS) {
-    internal_node_split_and_insert(table, parent_page_num, child_page_num);
-    return;
-  }
-
-  uint32_t right_child_page_num = *internal_node_right_child(parent);
-  
-  if (right_child_page_num == INVALID_PAGE_NUM) {
-    *internal_node_right_child(parent) = child_page_num;
+// The child taken at path level `level` has split; adds right_page_num next to
+// it, splitting this node in turn when it is already full. append is set when
+// the split came from appending to the rightmost leaf.
+void internal_node_insert(Table* table, TreePath* path, uint32_t level,
+                          uint32_t left_max, uint32_t right_page_num, bool append) {
+  void* node = get_page(table->pager, path->page_nums[level]);
+  if (*internal_node_num_keys(node) >= INTERNAL_NODE_MAX_KEYS(table->pager)) {
+    internal_node_split_and_insert(table, path, level, left_max, right_page_num, append);
     return;
   }
-
-  void* right_child = get_page(table->pager, right_child_page_num);
- 
-  *internal_node_num_keys(parent) = original_num_keys + 1;
-
-  if (child_max_key > get_node_max_key(table->pager, right_child)) {
-   
-    *internal_node_child(parent, original_num_keys) = right_child_page_num;
-    *internal_node_key(parent, original_num_keys) =
-        get_node_max_key(table->pager, right_child);
-    *internal_node_right_child(parent) = child_page_num;
-  } else {
-    
-    for (uint32_t i = original_num_keys; i > index; i--) {
-      void* destination = internal_node_cell(parent, i);
-      void* source = internal_node_cell(parent, i - 1);
-      memcpy(destination, source, INTERNAL_NODE_CELL_SIZE);
-    }
-    *internal_node_child(parent, index) = child_page_num;
-    *internal_node_key(parent, index) = child_max_key;
-  }
+  internal_node_insert_cell(node, path->child_indexes[level], left_max, right_page_num);
+  mark_page_dirty(table->pager, node);
 }
 
-void update_internal_node_key(void* node, uint32_t old_key, uint32_t new_key) {
-  uint32_t old_child_index = internal_node_find_child(node, old_key);
-  *internal_node_key(node, old_child_index) = new_key;
-}
-
-void internal_node_split_and_insert(Table* table, uint32_t parent_page_num, uint32_t child_page_num) {
-  uint32_t old_page_num = parent_page_num;
-  void* old_node = get_page(table->pager,parent_page_num);
-  uint32_t old_max = get_node_max_key(table->pager, old_node);
-
-  void* child = get_page(table->pager, child_page_num); 
-  uint32_t child_max = get_node_max_key(table->pager, child);
-
-  uint32_t new_page_num = get_unused_page_num(table->pager);
-
-  uint32_t splitting_root = is_node_root(old_node);
-
-  void* parent;
-  void* new_node;
-  if (splitting_root) {
-    create_new_root(table, new_page_num);
-    parent = get_page(table->pager,table->root_page_num);
-   
-    old_page_num = *internal_node_child(parent,0);
-    old_node = get_page(table->pager, old_page_num);
+// Moves the upper half of a full node into a new right sibling, inserts the
+// split child into whichever half it now belongs to and hands the new sibling
+// to the parent. When appending, node keeps all but its last key and the new
+// sibling starts with just the split child, as a leaf split does for appends.
+void internal_node_split_and_insert(Table* table, TreePath* path, uint32_t level,
+                                    uint32_t left_max, uint32_t right_page_num, bool append) {
+  Pager* pager = table->pager;
+  if (level == 0) {
+    create_new_root(table, path);
+    level = 1;
+  }
+  void* node = get_page(pager, path->page_nums[level]);
+  uint32_t new_page_num = get_unused_page_num(pager);
+  void* new_node = get_page(pager, new_page_num);
+  initialize_internal_node(new_node);
+
+  // node keeps the children up to and including `split` and the rest move
+  // over. Key `split` already bounds every key under child `split`, so it
+  // becomes node's key in the parent without reading down to a leaf.
+  uint32_t num_keys = *internal_node_num_keys(node);
+  uint32_t split = append ? num_keys - 1 : num_keys / 2;
+  uint32_t moved = num_keys - split - 1;
+  uint32_t node_max = *internal_node_key(node, split);
+  memcpy(internal_node_cell(new_node, 0), internal_node_cell(node, split + 1),
+         moved * INTERNAL_NODE_CELL_SIZE);
+  *internal_node_num_keys(new_node) = moved;
+  *internal_node_right_child(new_node) = *internal_node_right_child(node);
+  *internal_node_right_child(node) = *internal_node_child(node, split);
+  *internal_node_num_keys(node) = split;
+
+  uint32_t index = path->child_indexes[level];
+  if (index <= split) {
+    internal_node_insert_cell(node, index, left_max, right_page_num);
   } else {
-    parent = get_page(table->pager,*node_parent(old_node));
-    new_node = get_page(table->pager, new_page_num);
-    initialize_internal_node(new_node);
+    internal_node_insert_cell(new_node, index - split - 1, left_max, right_page_num);
   }
-  
-  uint32_t* old_num_keys = internal_node_num_keys(old_node);
-
-  uint32_t cur_page_num = *internal_node_right_child(old_node);
-  void* cur = get_page(table->pager, cur_page_num);
-
-  internal_node_insert(table, new_page_num, cur_page_num);
-  *node_parent(cur) = new_page_num;
-  *internal_node_right_child(old_node) = INVALID_PAGE_NUM;
-  
-  for (int i = INTERNAL_NODE_MAX_KEYS - 1; i > INTERNAL_NODE_MAX_KEYS / 2; i--) {
-    cur_page_num = *internal_node_child(old_node, i);
-    cur = get_page(table->pager, cur_page_num);
+  mark_page_dirty(pager, node);
+  mark_page_dirty(pager, new_node);
 
-    internal_node_insert(table, new_page_num, cur_page_num);
-    *node_parent(cur) = new_page_num;
-
-    (*old_num_keys)--;
-  }
-
-  *internal_node_right_child(old_node) = *internal_node_child(old_node,*old_num_keys - 1);
-  (*old_num_keys)--;
-
-  uint32_t max_after_split = get_node_max_key(table->pager, old_node);
-
-  uint32_t destination_page_num = child_max < max_after_split ? old_page_num : new_page_num;
-
-  internal_node_insert(table, destination_page_num, child_page_num);
-  *node_parent(child) = destination_page_num;
-
-  
-
-  update_internal_node_key(parent, old_max, get_node_max_key(table->pager, old_node));
-
-  if (!splitting_root) {
-    internal_node_insert(table,*node_parent(old_node),new_page_num);
-    *node_parent(new_node) = *node_parent(old_node);
-    *(node_next(new_node)) = *(node_next(old_node));
-    *(node_next(old_node)) = new_page_num;
-    *node_prev(new_node) = old_page_num;
-  }
-  
+  internal_node_insert(table, path, level - 1, node_max, new_page_num, append);
 }
 
-void borrow_from_left_internal(Pager* pager, void* node, void * left, void* par){
-  uint32_t num = *internal_node_num_keys(node);
-  *(internal_node_num_keys(node))+=1;
-  uint32_t old_max;
-  for(uint32_t i= 0; i<*internal_node_num_keys(par);i++){
-    if(*internal_node_child(par,i) == *node_prev(node)){
-      old_max = *internal_node_key(par,i);
-      break;
-    }
-  }
-  for(uint32_t i=num;i>0;i--){
-    memcpy(internal_node_cell(node,i),internal_node_cell(node,i-1),INTERNAL_NODE_CELL_SIZE);
-  }
-  uint32_t node_num = *node_next(left);
-  
-  *internal_node_child(node,0) = *internal_node_right_child(left);
-  uint32_t num2 = *internal_node_num_keys(left);
-  *internal_node_key(node,0) = old_max;
-  *internal_node_right_child(left) = * internal_node_child(left,num2-1);
-  uint32_t new_max = *internal_node_key(left,num2-1);
-  *(internal_node_num_keys(left))-=1;
-
-  int32_t child_num = *internal_node_child(node,0);
-  void* child = get_page(pager, child_num);
-  *node_parent(child) = node_num;
-
-  if(par!=NULL){
-    update_internal_node_key(par,old_max,new_max);
-  }
+// Moves left's last child over to the front of node. index is node's position
+// in parent.
+void borrow_from_left_internal(Pager* pager, void* node, void* left, void* parent,
+                               uint32_t index) {
+  uint32_t num_keys = *internal_node_num_keys(node);
+  uint32_t left_num_keys = *internal_node_num_keys(left);
+  memmove(internal_node_cell(node, 1), internal_node_cell(node, 0),
+          num_keys * INTERNAL_NODE_CELL_SIZE);
+  *internal_node_num_keys(node) = num_keys + 1;
+  *internal_node_cell(node, 0) = *internal_node_right_child(left);
+  *internal_node_key(node, 0) = *internal_node_key(parent, index - 1);
+
+  *internal_node_key(parent, index - 1) = *internal_node_key(left, left_num_keys - 1);
+  *internal_node_right_child(left) = *internal_node_cell(left, left_num_keys - 1);
+  *internal_node_num_keys(left) = left_num_keys - 1;
+
+  mark_page_dirty(pager, node);
+  mark_page_dirty(pager, left);
+  mark_page_dirty(pager, parent);
 }
 
-void borrow_from_right_internal(Pager * pager, void* node, void * right, void * par){
-
-  
-
-  uint32_t num2 = *internal_node_num_keys(node);
-  uint32_t old_max;
-  for(uint32_t i= 0; i<*internal_node_num_keys(par);i++){
-    if(*internal_node_child(par,i) == *node_prev(right)){
-      old_max = *internal_node_key(par,i);
-      break;
-    }
-  }
-
-  *(internal_node_num_keys(node))+=1;
-  uint32_t node_num = *node_prev(right);
-  int32_t child_num = *internal_node_child(right,0);
-  void* child = get_page(pager, child_num);
-  *node_parent(child) = node_num;
-
-  *internal_node_child(node,num2) = *internal_node_right_child(node);
-  *internal_node_key(node,num2) = old_max;
-  *internal_node_right_child(node) = *internal_node_child(right,0);
-  uint32_t new_max = *internal_node_key(right,0);
-
-  uint32_t num = *internal_node_num_keys(right);
-  for(uint32_t i=num-1;i>=1;i--){
-    memcpy(internal_node_cell(right,i-1),internal_node_cell(right,i),INTERNAL_NODE_CELL_SIZE);
-  }
-  *(internal_node_num_keys(right))-=1;
+// Moves right's first child over to the end of node. index is node's position
+// in parent.
+void borrow_from_right_internal(Pager* pager, void* node, void* right, void* parent,
+                                uint32_t index) {
+  uint32_t num_keys = *internal_node_num_keys(node);
+  uint32_t right_num_keys = *internal_node_num_keys(right);
+  *internal_node_num_keys(node) = num_keys + 1;
+  *internal_node_cell(node, num_keys) = *internal_node_right_child(node);
+  *internal_node_key(node, num_keys) = *internal_node_key(parent, index);
+  *internal_node_right_child(node) = *internal_node_cell(right, 0);
+
+  *internal_node_key(parent, index) = *internal_node_key(right, 0);
+  memmove(internal_node_cell(right, 0), internal_node_cell(right, 1),
+          (right_num_keys - 1) * INTERNAL_NODE_CELL_SIZE);
+  *internal_node_num_keys(right) = right_num_keys - 1;
+
+  mark_page_dirty(pager, node);
+  mark_page_dirty(pager, right);
+  mark_page_dirty(pager, parent);
+}
 
-  if(par!=NULL){
-    update_internal_node_key(par,old_max,new_max);
-  }
+// Appends right's children to left, its neighbour at index in the parent
+// found at path level `level`, and frees right.
+void merge_internal(Table* table, TreePath* path, uint32_t level, void* left, void* right,
+                    uint32_t index) {
+  void* parent = get_page(table->pager, path->page_nums[level]);
+  uint32_t right_page_num = *internal_node_child(parent, index + 1);
+  uint32_t num_keys = *internal_node_num_keys(left);
+  uint32_t right_num_keys = *internal_node_num_keys(right);
+
+  *internal_node_cell(left, num_keys) = *internal_node_right_child(left);
+  *internal_node_key(left, num_keys) = *internal_node_key(parent, index);
+  memcpy(internal_node_cell(left, num_keys + 1), internal_node_cell(right, 0),
+         right_num_keys * INTERNAL_NODE_CELL_SIZE);
+  *internal_node_num_keys(left) = num_keys + 1 + right_num_keys;
+  *internal_node_right_child(left) = *internal_node_right_child(right);
+  mark_page_dirty(table->pager, left);
+
+  delete_page(table->pager, right_page_num);
+  delete_from_internal(table, path, level, index);
 }
 
-void merge_internal(void* node, void* left, void* par, Table* table ) {
-  uint32_t old_max;
-  for(uint32_t i= 0; i<*internal_node_num_keys(par);i++){
-    if(*internal_node_child(par,i) == *node_prev(left)){
-      old_max = *internal_node_key(par,i);
-      break;
+// Drops the key between children index and index + 1 of the node at path
+// level `level` once the right one has been merged into the left, then
+// borrows or merges if the node is left too small.
+void delete_from_internal(Table* table, TreePath* path, uint32_t level, uint32_t index) {
+  Pager* pager = table->pager;
+  void* node = get_page(pager, path->page_nums[level]);
+  uint32_t num_keys = *internal_node_num_keys(node);
+  *internal_node_child(node, index + 1) = *internal_node_child(node, index);
+  memmove(internal_node_cell(node, index), internal_node_cell(node, index + 1),
+          (num_keys - index - 1) * INTERNAL_NODE_CELL_SIZE);
+  *internal_node_num_keys(node) = --num_keys;
+  mark_page_dirty(pager, node);
+
+  if (level == 0) {
+    if (num_keys == 0) {
+      delete_from_root(table);
     }
+    return;
   }
-  uint32_t node_pg_num = *node_next(left);
-  uint32_t num = *internal_node_num_keys(left);
-  uint32_t num2 = *internal_node_num_keys(node);
-  *internal_node_num_keys(node)+=num+1;
-  for(uint32_t i=0;i<num2;i++){
-    memcpy(internal_node_cell(node,i+num+1),internal_node_cell(node,i),INTERNAL_NODE_CELL_SIZE);
-  }
-  for(uint32_t i=0;i<num;i++){
-    uint32_t child_pg_num = *internal_node_child(left,i);
-    void* child = get_page(table->pager,child_pg_num);
-    *node_parent(child) = node_pg_num;
-    memcpy(internal_node_cell(node,i),internal_node_cell(left,i),INTERNAL_NODE_CELL_SIZE);
+  // With lazy deletes a node only needs two children, so an empty leaf
+  // below it always has a sibling to merge into.
+  uint32_t min_keys = table->lazy_deletes ? 1 : INTERNAL_NODE_MIN_KEYS(pager);
+  if (num_keys >= min_keys) {
+    return;
   }
-  uint32_t child_pg_num = *internal_node_child(left,num);
- 
-  void* child = get_page(table->pager,child_pg_num);
-
 
-  uint32_t new_key = get_node_max_key(table->pager,child);
-
-
-  *node_parent(child) = node_pg_num;
-  *internal_node_key(node,num) = new_key;
-  *internal_node_child(node,num) = child_pg_num;
-
-
-  delete_page(table->pager,*node_prev(node));
-
-
-  if(is_node_root(par)){
-    delete_from_root(table,old_max);
+  void* parent = get_page(pager, path->page_nums[level - 1]);
+  uint32_t parent_index = path->child_indexes[level - 1];
+  void* left = NULL;
+  void* right = NULL;
+  if (parent_index > 0) {
+    left = get_page(pager, *internal_node_child(parent, parent_index - 1));
   }
-  else{
-    delete_from_internal(table,*node_parent(node),old_max);
+  if (parent_index < *internal_node_num_keys(parent)) {
+    right = get_page(pager, *internal_node_child(parent, parent_index + 1));
   }
 
-}
-
-void delete_from_internal(Table* table,uint32_t node_page_num, uint32_t key){
-  void* node = get_page(table->pager,node_page_num);
-  uint32_t num_cell = *internal_node_num_keys(node);
-  uint32_t idx  = internal_node_find_child(node,key); 
-  for(uint32_t i=idx+1;i<num_cell;i++){
-    memcpy(internal_node_cell(node,i-1),internal_node_cell(node,i),INTERNAL_NODE_CELL_SIZE);
-  }
-  *internal_node_num_keys(node)-=1;
-  if(*internal_node_num_keys(node)<INTERNAL_NODE_MIN_KEYS){
-    uint32_t left_pg_num = *node_prev(node);
-    uint32_t right_pg_num = *node_next(node);
-    uint32_t par_pg_num = *node_parent(node);
-    void * left = NULL;
-    void * right = NULL;  
-    void * par = NULL;
-    if(left_pg_num!=INVALID_PAGE_NUM){
-      left = get_page(table->pager,left_pg_num);
-    }
-    if(right_pg_num!=INVALID_PAGE_NUM){
-      right = get_page(table->pager,right_pg_num);
-    }
-    if(par_pg_num!=INVALID_PAGE_NUM){
-      par = get_page(table->pager,par_pg_num);
-    }
-    if((left!=NULL)&&(*internal_node_num_keys(left)>INTERNAL_NODE_MIN_KEYS)&&(*node_parent(left)==*node_parent(node))){
-      borrow_from_left_internal(table->pager,node,left,par);
-    }
-    else if((right!=NULL)&&(*internal_node_num_keys(right)>INTERNAL_NODE_MIN_KEYS)&&(*node_parent(right)==*node_parent(node))){
-      borrow_from_right_internal(table->pager,node,right,par);
-    }
-    else if((left!=NULL)&&(*node_parent(left)==*node_parent(node))){
-      merge_internal(node,left,par,table);
-    }
-    else if((right!=NULL)&&(*node_parent(right)==*node_parent(node))){
-      merge_internal(right,node,par,table);
-      
-    }
-    else{
-
-      printf("Error Deleting.\n");
-      exit(EXIT_FAILURE);
-    }
+  if (left != NULL && *internal_node_num_keys(left) > min_keys) {
+    borrow_from_left_internal(pager, node, left, parent, parent_index);
+  } else if (right != NULL && *internal_node_num_keys(right) > min_keys) {
+    borrow_from_right_internal(pager, node, right, parent, parent_index);
+  } else if (left != NULL) {
+    merge_internal(table, path, level - 1, left, node, parent_index - 1);
+  } else {
+    merge_internal(table, path, level - 1, node, right, parent_index);
   }
-}
\ No newline at end of file
+}
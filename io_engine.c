@@ -0,0 +1,213 @@
+#include "define.h"
+
+// Batched page I/O for the pager. The io_uring engine queues a whole batch of
+// reads or writes, submits them with one io_uring_enter() and reaps the
+// completions; the sync engine issues the same requests one preadv()/pwritev()
+// at a time. io_uring is driven through the raw syscalls so no liburing is
+// needed, and io_engine_open() falls back to the sync engine when the kernel
+// refuses to set up a ring.
+
+#ifdef HAVE_IO_URING
+static int sys_io_uring_setup(uint32_t entries, struct io_uring_params* params) {
+  return syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int sys_io_uring_enter(int fd, uint32_t to_submit, uint32_t min_complete,
+                              uint32_t flags) {
+  return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static bool io_uring_open(IoEngine* engine) {
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+  int fd = sys_io_uring_setup(IO_URING_ENTRIES, &params);
+  if (fd < 0) {
+    return false;
+  }
+
+  engine->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(uint32_t);
+  engine->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  engine->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+  engine->sq_ring = mmap(NULL, engine->sq_ring_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  engine->cq_ring = mmap(NULL, engine->cq_ring_size, PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+  engine->sqes = mmap(NULL, engine->sqes_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (engine->sq_ring == MAP_FAILED || engine->cq_ring == MAP_FAILED ||
+      engine->sqes == MAP_FAILED) {
+    close(fd);
+    return false;
+  }
+
+  engine->ring_fd = fd;
+  engine->sq_entries = params.sq_entries;
+  engine->sq_tail = engine->sq_ring + params.sq_off.tail;
+  engine->sq_mask = engine->sq_ring + params.sq_off.ring_mask;
+  engine->sq_array = engine->sq_ring + params.sq_off.array;
+  engine->cq_head = engine->cq_ring + params.cq_off.head;
+  engine->cq_tail = engine->cq_ring + params.cq_off.tail;
+  engine->cq_mask = engine->cq_ring + params.cq_off.ring_mask;
+  engine->cqes = engine->cq_ring + params.cq_off.cqes;
+  return true;
+}
+#else
+static bool io_uring_open(IoEngine* engine) {
+  return false;
+}
+#endif
+
+void io_engine_open(IoEngine* engine, IoEngineType type) {
+  engine->type = IO_ENGINE_SYNC;
+  engine->batches = 0;
+  engine->requests = 0;
+  engine->syscalls = 0;
+  if (type == IO_ENGINE_URING) {
+    if (io_uring_open(engine)) {
+      engine->type = IO_ENGINE_URING;
+    } else {
+      printf("io_uring is not available, using pread/pwrite.\n");
+    }
+  }
+}
+
+void io_engine_close(IoEngine* engine) {
+  if (engine->type != IO_ENGINE_URING) {
+    return;
+  }
+#ifdef HAVE_IO_URING
+  munmap(engine->sqes, engine->sqes_size);
+  munmap(engine->cq_ring, engine->cq_ring_size);
+  munmap(engine->sq_ring, engine->sq_ring_size);
+  close(engine->ring_fd);
+#endif
+}
+
+// Finishes a request the kernel only partly served, or serves it entirely
+// when running on the sync engine.
+static void io_complete_sync(IoEngine* engine, int fd, IoRequest* request, size_t done) {
+  size_t length = 0;
+  for (uint32_t i = 0; i < request->iov_count; i++) {
+    length += request->iov[i].iov_len;
+  }
+  while (done < length) {
+    void* buffer = NULL;
+    size_t skip = done;
+    uint32_t i = 0;
+    while (skip >= request->iov[i].iov_len) {
+      skip -= request->iov[i].iov_len;
+      i++;
+    }
+    buffer = request->iov[i].iov_base + skip;
+    size_t chunk = request->iov[i].iov_len - skip;
+    ssize_t result;
+    if (request->write) {
+      result = pwrite(fd, buffer, chunk, request->offset + done);
+    } else {
+      result = pread(fd, buffer, chunk, request->offset + done);
+    }
+    engine->syscalls++;
+    if (result == -1) {
+      printf("Error %s: %d\n", request->write ? "writing" : "reading", errno);
+      exit(EXIT_FAILURE);
+    }
+    if (result == 0) {
+      // Reading past the end of the file: the rest of the page is zeroes.
+      memset(buffer, 0, chunk);
+      result = chunk;
+    }
+    done += result;
+  }
+}
+
+#ifdef HAVE_IO_URING
+static void io_submit_uring(IoEngine* engine, int fd, IoRequest* requests, uint32_t count) {
+  uint32_t submitted = 0;
+  while (submitted < count) {
+    uint32_t batch = count - submitted;
+    if (batch > engine->sq_entries) {
+      batch = engine->sq_entries;
+    }
+    uint32_t tail = *engine->sq_tail;
+    for (uint32_t i = 0; i < batch; i++) {
+      IoRequest* request = &requests[submitted + i];
+      uint32_t index = (tail + i) & *engine->sq_mask;
+      struct io_uring_sqe* sqe = &engine->sqes[index];
+      memset(sqe, 0, sizeof(*sqe));
+      sqe->opcode = request->write ? IORING_OP_WRITEV : IORING_OP_READV;
+      sqe->fd = fd;
+      sqe->addr = (uint64_t)(uintptr_t)request->iov;
+      sqe->len = request->iov_count;
+      sqe->off = request->offset;
+      sqe->user_data = submitted + i;
+      engine->sq_array[index] = index;
+    }
+    __atomic_store_n(engine->sq_tail, tail + batch, __ATOMIC_RELEASE);
+
+    if (sys_io_uring_enter(engine->ring_fd, batch, batch, IORING_ENTER_GETEVENTS) < 0) {
+      printf("Error submitting io_uring batch: %d\n", errno);
+      exit(EXIT_FAILURE);
+    }
+    engine->syscalls++;
+
+    uint32_t reaped = 0;
+    while (reaped < batch) {
+      uint32_t head = *engine->cq_head;
+      uint32_t cq_tail = __atomic_load_n(engine->cq_tail, __ATOMIC_ACQUIRE);
+      if (head == cq_tail) {
+        if (sys_io_uring_enter(engine->ring_fd, 0, 1, IORING_ENTER_GETEVENTS) < 0) {
+          printf("Error waiting for io_uring completions: %d\n", errno);
+          exit(EXIT_FAILURE);
+        }
+        engine->syscalls++;
+        continue;
+      }
+      struct io_uring_cqe* cqe = &engine->cqes[head & *engine->cq_mask];
+      IoRequest* request = &requests[cqe->user_data];
+      if (cqe->res < 0) {
+        printf("Error %s: %d\n", request->write ? "writing" : "reading", -cqe->res);
+        exit(EXIT_FAILURE);
+      }
+      io_complete_sync(engine, fd, request, cqe->res);
+      __atomic_store_n(engine->cq_head, head + 1, __ATOMIC_RELEASE);
+      reaped++;
+    }
+    submitted += batch;
+  }
+}
+#endif
+
+// Runs every request in the batch to completion. Reads that run past the end
+// of the file are zero-filled.
+void io_engine_submit(IoEngine* engine, int fd, IoRequest* requests, uint32_t count) {
+  if (count == 0) {
+    return;
+  }
+  engine->batches++;
+  engine->requests += count;
+#ifdef HAVE_IO_URING
+  if (engine->type == IO_ENGINE_URING) {
+    io_submit_uring(engine, fd, requests, count);
+    return;
+  }
+#endif
+  for (uint32_t i = 0; i < count; i++) {
+    IoRequest* request = &requests[i];
+    ssize_t result;
+    if (request->write) {
+      result = pwritev(fd, request->iov, request->iov_count, request->offset);
+    } else {
+      result = preadv(fd, request->iov, request->iov_count, request->offset);
+    }
+    engine->syscalls++;
+    if (result == -1) {
+      printf("Error %s: %d\n", request->write ? "writing" : "reading", errno);
+      exit(EXIT_FAILURE);
+    }
+    io_complete_sync(engine, fd, request, result);
+  }
+}
+
+const char* io_engine_name(IoEngine* engine) {
+  return engine->type == IO_ENGINE_URING ? "io_uring" : "pread/pwrite";
+}
@@ -0,0 +1,291 @@
+#include "define.h"
+
+// Nodes of the trees keyed by byte strings rather than uint32_t ids. Leaves
+// and internal nodes are both slotted like table leaves: sorted (record
+// offset, key head) slots at the front, and records of payload | key length |
+// key packed at the back. A leaf's payload is the value stored under the key;
+// an internal node's is the child holding the keys below the separator, with
+// the rightmost child in the header.
+//
+// Keys compare as bytes, the shorter first when one is a prefix of the other,
+// so integers stored big-endian keep their numeric order. The head of a key is
+// the KEY_HEAD_SIZE bytes after the prefix every key in its node shares, read
+// as a big-endian number: heads order the same way as the keys, so searches
+// run key_search() over the slots and only read records when heads tie.
+
+int key_compare(const uint8_t* a, uint32_t a_length, const uint8_t* b, uint32_t b_length) {
+  int order = memcmp(a, b, a_length < b_length ? a_length : b_length);
+  if (order != 0) {
+    return order;
+  }
+  return (a_length > b_length) - (a_length < b_length);
+}
+
+uint32_t key_common_prefix(const uint8_t* a, uint32_t a_length, const uint8_t* b,
+                           uint32_t b_length) {
+  uint32_t length = a_length < b_length ? a_length : b_length;
+  uint32_t i = 0;
+  while (i < length && a[i] == b[i]) {
+    i++;
+  }
+  return i;
+}
+
+// Reads the KEY_HEAD_SIZE bytes of key from offset on, padded with zeroes.
+uint32_t key_head(const uint8_t* key, uint32_t length, uint32_t offset) {
+  uint32_t head = 0;
+  for (uint32_t i = offset; i < offset + KEY_HEAD_SIZE; i++) {
+    head = head << 8 | (i < length ? key[i] : 0);
+  }
+  return head;
+}
+
+// Returns the length of the shortest prefix of right that is still greater
+// than left, which is all a separator between the two has to keep.
+uint32_t key_separator_length(const uint8_t* left, uint32_t left_length,
+                              const uint8_t* right, uint32_t right_length) {
+  return key_common_prefix(left, left_length, right, right_length) + 1;
+}
+
+void key_encode_uint32(uint32_t value, uint8_t* key) {
+  for (uint32_t i = 0; i < sizeof(uint32_t); i++) {
+    key[i] = value >> (8 * (sizeof(uint32_t) - 1 - i));
+  }
+}
+
+void key_encode_uint64(uint64_t value, uint8_t* key) {
+  for (uint32_t i = 0; i < sizeof(uint64_t); i++) {
+    key[i] = value >> (8 * (sizeof(uint64_t) - 1 - i));
+  }
+}
+
+uint32_t* key_node_num_cells(void* node) {
+  return node + KEY_NODE_NUM_CELLS_OFFSET;
+}
+
+uint32_t* key_node_heap_size(void* node) {
+  return node + KEY_NODE_HEAP_SIZE_OFFSET;
+}
+
+uint32_t* key_node_right_child(void* node) {
+  return node + KEY_NODE_RIGHT_CHILD_OFFSET;
+}
+
+uint32_t* key_node_prefix_length(void* node) {
+  return node + KEY_NODE_PREFIX_LENGTH_OFFSET;
+}
+
+uint32_t* key_node_slot(void* node, uint32_t cell_num) {
+  return node + KEY_NODE_HEADER_SIZE + cell_num * KEY_NODE_SLOT_SIZE;
+}
+
+uint32_t* key_node_head(void* node, uint32_t cell_num) {
+  return (void*)key_node_slot(node, cell_num) + KEY_NODE_OFFSET_SIZE;
+}
+
+uint32_t* key_node_payload(void* node, uint32_t cell_num) {
+  return node + *key_node_slot(node, cell_num);
+}
+
+uint32_t key_node_key_length(void* node, uint32_t cell_num) {
+  return *(uint16_t*)((void*)key_node_payload(node, cell_num) + KEY_NODE_PAYLOAD_SIZE);
+}
+
+uint8_t* key_node_key(void* node, uint32_t cell_num) {
+  return (void*)key_node_payload(node, cell_num) + KEY_NODE_RECORD_HEADER_SIZE;
+}
+
+// Returns child index of an internal node; the last one is the right child.
+uint32_t key_node_child(void* node, uint32_t index) {
+  if (index == *key_node_num_cells(node)) {
+    return *key_node_right_child(node);
+  }
+  return *key_node_payload(node, index);
+}
+
+void key_node_set_child(void* node, uint32_t index, uint32_t page_num) {
+  if (index == *key_node_num_cells(node)) {
+    *key_node_right_child(node) = page_num;
+  } else {
+    *key_node_payload(node, index) = page_num;
+  }
+}
+
+void initialize_key_node(void* node, NodeType type) {
+  set_node_type(node, type);
+  set_node_root(node, false);
+  *key_node_num_cells(node) = 0;
+  *key_node_heap_size(node) = 0;
+  *key_node_right_child(node) = INVALID_PAGE_NUM;
+  *key_node_prefix_length(node) = 0;
+  *(node_next(node)) = INVALID_PAGE_NUM;
+  *(node_prev(node)) = INVALID_PAGE_NUM;
+}
+
+uint32_t key_node_used_bytes(void* node) {
+  return *key_node_num_cells(node) * KEY_NODE_SLOT_SIZE + *key_node_heap_size(node);
+}
+
+// Returns whether a key of length bytes fits in node. Nodes fill up by bytes;
+// the fan-out of the file only caps the count, as it does for table leaves.
+bool key_node_has_room(Pager* pager, void* node, uint32_t length) {
+  uint32_t max_cells = get_node_type(node) == NODE_LEAF ? LEAF_NODE_MAX_CELLS(pager)
+                                                        : INTERNAL_NODE_MAX_KEYS(pager);
+  return *key_node_num_cells(node) < max_cells &&
+         key_node_used_bytes(node) + KEY_NODE_SLOT_SIZE + KEY_NODE_RECORD_HEADER_SIZE + length <=
+             KEY_NODE_SPACE_FOR_CELLS(pager);
+}
+
+// Sets how many leading bytes every key in node shares, and recomputes the
+// heads from there on.
+static void key_node_set_prefix(void* node, uint32_t prefix_length) {
+  *key_node_prefix_length(node) = prefix_length;
+  for (uint32_t i = 0; i < *key_node_num_cells(node); i++) {
+    *key_node_head(node, i) =
+        key_head(key_node_key(node, i), key_node_key_length(node, i), prefix_length);
+  }
+}
+
+// Lengthens the shared prefix to what node's first and last key have in
+// common, after a split has narrowed the range of its keys.
+void key_node_fit_prefix(void* node) {
+  uint32_t num_cells = *key_node_num_cells(node);
+  uint32_t prefix_length = 0;
+  if (num_cells > 1) {
+    prefix_length = key_common_prefix(key_node_key(node, 0), key_node_key_length(node, 0),
+                                      key_node_key(node, num_cells - 1),
+                                      key_node_key_length(node, num_cells - 1));
+  }
+  key_node_set_prefix(node, prefix_length);
+}
+
+// Adds key with its payload at cell_num. A key outside the shared prefix
+// shortens it. The caller has checked that the node has room.
+void key_node_insert_cell(Pager* pager, void* node, uint32_t cell_num, const uint8_t* key,
+                          uint32_t length, uint32_t payload) {
+  uint32_t num_cells = *key_node_num_cells(node);
+  uint32_t prefix_length = *key_node_prefix_length(node);
+  if (num_cells == 0) {
+    prefix_length = 0;
+  } else if (prefix_length > 0) {
+    uint32_t shared = key_common_prefix(key, length, key_node_key(node, 0), prefix_length);
+    if (shared < prefix_length) {
+      key_node_set_prefix(node, shared);
+      prefix_length = shared;
+    }
+  }
+  *key_node_prefix_length(node) = prefix_length;
+
+  memmove(key_node_slot(node, cell_num + 1), key_node_slot(node, cell_num),
+          (num_cells - cell_num) * KEY_NODE_SLOT_SIZE);
+  *key_node_heap_size(node) += KEY_NODE_RECORD_HEADER_SIZE + length;
+  *key_node_slot(node, cell_num) = pager->page_size - *key_node_heap_size(node);
+  *key_node_head(node, cell_num) = key_head(key, length, prefix_length);
+  *key_node_num_cells(node) = num_cells + 1;
+
+  void* record = key_node_payload(node, cell_num);
+  *(uint32_t*)record = payload;
+  *(uint16_t*)(record + KEY_NODE_PAYLOAD_SIZE) = length;
+  memcpy(record + KEY_NODE_RECORD_HEADER_SIZE, key, length);
+}
+
+// Removes cell_num. The records below its record move up over it, so the
+// heap stays packed.
+void key_node_remove_cell(Pager* pager, void* node, uint32_t cell_num) {
+  uint32_t num_cells = *key_node_num_cells(node);
+  uint32_t hole = *key_node_slot(node, cell_num);
+  uint32_t size = KEY_NODE_RECORD_HEADER_SIZE + key_node_key_length(node, cell_num);
+  uint32_t bottom = pager->page_size - *key_node_heap_size(node);
+  memmove(node + bottom + size, node + bottom, hole - bottom);
+  for (uint32_t i = 0; i < num_cells; i++) {
+    if (*key_node_slot(node, i) < hole) {
+      *key_node_slot(node, i) += size;
+    }
+  }
+  *key_node_heap_size(node) -= size;
+  memmove(key_node_slot(node, cell_num), key_node_slot(node, cell_num + 1),
+          (num_cells - cell_num - 1) * KEY_NODE_SLOT_SIZE);
+  *key_node_num_cells(node) = num_cells - 1;
+}
+
+// Returns the index of the first key that is at least key, or the number of
+// cells if there is none. found is set when that key equals key.
+uint32_t key_node_find(void* node, const uint8_t* key, uint32_t length, bool* found) {
+  uint32_t num_cells = *key_node_num_cells(node);
+  *found = false;
+  if (num_cells == 0) {
+    return 0;
+  }
+  // A key outside the shared prefix sorts before or after every key here.
+  uint32_t prefix_length = *key_node_prefix_length(node);
+  if (prefix_length > 0) {
+    int order = key_compare(key, length < prefix_length ? length : prefix_length,
+                            key_node_key(node, 0), prefix_length);
+    if (order != 0) {
+      return order < 0 ? 0 : num_cells;
+    }
+  }
+
+  uint32_t head = key_head(key, length, prefix_length);
+  uint32_t index = key_search(key_node_slot(node, 0), num_cells, head);
+  while (index < num_cells && *key_node_head(node, index) == head) {
+    int order = key_compare(key_node_key(node, index), key_node_key_length(node, index),
+                            key, length);
+    if (order >= 0) {
+      *found = order == 0;
+      break;
+    }
+    index++;
+  }
+  return index;
+}
+
+// Returns the index of the child of an internal node that covers key. Child
+// i holds the keys from separator i - 1 up to, but not including,
+// separator i.
+uint32_t key_node_find_child(void* node, const uint8_t* key, uint32_t length) {
+  bool found;
+  uint32_t index = key_node_find(node, key, length, &found);
+  return found ? index + 1 : index;
+}
+
+// Returns where a full node splits so both halves hold about the same bytes:
+// a cell stays on the left while its middle byte is in the left half. Each
+// half keeps at least one cell.
+uint32_t key_node_split_point(void* node) {
+  uint32_t num_cells = *key_node_num_cells(node);
+  uint32_t total = key_node_used_bytes(node);
+  uint32_t split = 0;
+  uint32_t left_bytes = 0;
+  while (split + 1 < num_cells) {
+    uint32_t size = KEY_NODE_SLOT_SIZE + KEY_NODE_RECORD_HEADER_SIZE +
+                    key_node_key_length(node, split);
+    if (split > 0 && 2 * left_bytes + size > total) {
+      break;
+    }
+    left_bytes += size;
+    split++;
+  }
+  return split;
+}
+
+// Moves the cells of node from split on into the empty node right, repacks
+// the ones node keeps and fits both prefixes.
+void key_node_split(Pager* pager, void* node, void* right, uint32_t split) {
+  uint32_t num_cells = *key_node_num_cells(node);
+  void* old_node = malloc(pager->page_size);
+  memcpy(old_node, node, pager->page_size);
+  *key_node_num_cells(node) = 0;
+  *key_node_heap_size(node) = 0;
+  *key_node_prefix_length(node) = 0;
+
+  for (uint32_t i = 0; i < num_cells; i++) {
+    void* destination = i < split ? node : right;
+    uint32_t destination_cell = i < split ? i : i - split;
+    key_node_insert_cell(pager, destination, destination_cell, key_node_key(old_node, i),
+                         key_node_key_length(old_node, i), *key_node_payload(old_node, i));
+  }
+  free(old_node);
+  key_node_fit_prefix(node);
+  key_node_fit_prefix(right);
+}
@@ -0,0 +1,23 @@
+#include "define.h"
+
+// Searches for a key among sorted 8-byte cells of a uint32_t payload followed
+// by a uint32_t key, the layout of internal node cells (child, key) and leaf
+// slots (value offset, key). Each step halves the range with a conditional
+// move instead of a branch on the key, so the search does not stall on
+// compares the CPU cannot predict.
+
+// Returns the index of the first of count cells whose key is at least key,
+// or count if there is none.
+uint32_t key_search(const void* cells, uint32_t count, uint32_t key) {
+  const uint32_t* words = cells;
+  // Every key before lo is smaller and none from lo + n on is, so the answer
+  // stays within [lo, lo + n].
+  uint32_t lo = 0;
+  uint32_t n = count;
+  while (n > 1) {
+    uint32_t half = n / 2;
+    lo = words[2 * (lo + half) + 1] < key ? lo + half : lo;
+    n -= half;
+  }
+  return lo + (n == 1 && words[2 * lo + 1] < key);
+}
@@ -0,0 +1,314 @@
+#include "define.h"
+
+// B+ trees over key_node.c nodes, mapping byte-string keys to uint32_t
+// values. Keys in a tree are unique. The root page never moves, so the
+// caller only has to keep its page number.
+//
+// A leaf split hands its parent the shortest prefix of the right half's first
+// key that still sorts after the left half's last key, rather than a whole
+// key, so long keys with distinct beginnings still give internal nodes a high
+// fan-out. Deletes only free nodes once they are empty; sparse nodes are left
+// for a rebuild to pack.
+
+// Allocates the root of an empty tree and returns its page.
+uint32_t key_tree_create(Pager* pager) {
+  uint32_t page_num = get_unused_page_num(pager);
+  void* root = get_page(pager, page_num);
+  initialize_key_node(root, NODE_LEAF);
+  set_node_root(root, true);
+  mark_page_dirty(pager, root);
+  return page_num;
+}
+
+// Walks from the root down to the leaf where key is or would go, recording
+// the internal nodes passed in path. Returns the leaf's page.
+static uint32_t key_tree_descend(Pager* pager, uint32_t root_page_num, const uint8_t* key,
+                                 uint32_t length, TreePath* path) {
+  path->depth = 0;
+  uint32_t page_num = root_page_num;
+  void* node = get_page(pager, page_num);
+  while (get_node_type(node) == NODE_INTERNAL) {
+    if (path->depth == TREE_MAX_HEIGHT) {
+      printf("Tree is deeper than %d levels. Corrupt file.\n", TREE_MAX_HEIGHT);
+      exit(EXIT_FAILURE);
+    }
+    uint32_t child_index = key_node_find_child(node, key, length);
+    path->page_nums[path->depth] = page_num;
+    path->child_indexes[path->depth] = child_index;
+    path->depth++;
+    page_num = key_node_child(node, child_index);
+    node = get_page(pager, page_num);
+  }
+  return page_num;
+}
+
+// Moves the root's contents into a new page that becomes the only child of
+// the root, as create_new_root() does for the table. Returns the new page.
+static uint32_t key_tree_grow_root(Pager* pager, uint32_t root_page_num, TreePath* path) {
+  if (path->depth == TREE_MAX_HEIGHT) {
+    printf("Tree is deeper than %d levels.\n", TREE_MAX_HEIGHT);
+    exit(EXIT_FAILURE);
+  }
+  void* root = get_page(pager, root_page_num);
+  uint32_t child_page_num = get_unused_page_num(pager);
+  void* child = get_page(pager, child_page_num);
+  memcpy(child, root, pager->page_size);
+  set_node_root(child, false);
+
+  initialize_key_node(root, NODE_INTERNAL);
+  set_node_root(root, true);
+  *key_node_right_child(root) = child_page_num;
+  mark_page_dirty(pager, root);
+  mark_page_dirty(pager, child);
+
+  memmove(path->page_nums + 1, path->page_nums, path->depth * sizeof(uint32_t));
+  memmove(path->child_indexes + 1, path->child_indexes, path->depth * sizeof(uint32_t));
+  path->depth++;
+  path->page_nums[0] = root_page_num;
+  path->child_indexes[0] = 0;
+  if (path->depth > 1) {
+    path->page_nums[1] = child_page_num;
+  }
+  return child_page_num;
+}
+
+// Records in node that child index split: the child keeps the keys below
+// separator and right_page_num, holding the rest, becomes child index + 1.
+static void key_node_insert_child(Pager* pager, void* node, uint32_t index,
+                                  const uint8_t* separator, uint32_t length,
+                                  uint32_t right_page_num) {
+  key_node_insert_cell(pager, node, index, separator, length, key_node_child(node, index));
+  key_node_set_child(node, index + 1, right_page_num);
+  mark_page_dirty(pager, node);
+}
+
+// The child taken at path level `level` has split at separator; adds
+// right_page_num next to it, splitting this node in turn when it is full.
+// The separator at the split point moves up rather than being copied.
+static void key_tree_insert_child(Pager* pager, uint32_t root_page_num, TreePath* path,
+                                  uint32_t level, const uint8_t* separator, uint32_t length,
+                                  uint32_t right_page_num) {
+  void* node = get_page(pager, path->page_nums[level]);
+  if (key_node_has_room(pager, node, length)) {
+    key_node_insert_child(pager, node, path->child_indexes[level], separator, length,
+                          right_page_num);
+    return;
+  }
+
+  if (level == 0) {
+    key_tree_grow_root(pager, root_page_num, path);
+    level = 1;
+  }
+  node = get_page(pager, path->page_nums[level]);
+  uint32_t new_page_num = get_unused_page_num(pager);
+  void* new_node = get_page(pager, new_page_num);
+  initialize_key_node(new_node, NODE_INTERNAL);
+
+  // Cells up to `split` stay, and the child of cell `split` becomes node's
+  // right child. Its separator goes up to the parent.
+  uint32_t num_cells = *key_node_num_cells(node);
+  uint32_t split = key_node_split_point(node);
+  if (split > num_cells - 2) {
+    split = num_cells - 2;
+  }
+  uint8_t up[KEY_MAX_SIZE];
+  uint32_t up_length = key_node_key_length(node, split);
+  memcpy(up, key_node_key(node, split), up_length);
+  key_node_split(pager, node, new_node, split + 1);
+  *key_node_right_child(new_node) = *key_node_right_child(node);
+  *key_node_right_child(node) = *key_node_payload(node, split);
+  key_node_remove_cell(pager, node, split);
+
+  uint32_t index = path->child_indexes[level];
+  if (index <= split) {
+    key_node_insert_child(pager, node, index, separator, length, right_page_num);
+  } else {
+    key_node_insert_child(pager, new_node, index - split - 1, separator, length, right_page_num);
+  }
+  mark_page_dirty(pager, node);
+  mark_page_dirty(pager, new_node);
+
+  key_tree_insert_child(pager, root_page_num, path, level - 1, up, up_length, new_page_num);
+}
+
+// Splits the full leaf at page_num, the end of path, and inserts key into
+// whichever half it belongs in.
+static void key_tree_split_leaf(Pager* pager, uint32_t root_page_num, TreePath* path,
+                                uint32_t page_num, const uint8_t* key, uint32_t length,
+                                uint32_t value) {
+  if (path->depth == 0) {
+    page_num = key_tree_grow_root(pager, root_page_num, path);
+  }
+  void* node = get_page(pager, page_num);
+  uint32_t new_page_num = get_unused_page_num(pager);
+  void* new_node = get_page(pager, new_page_num);
+  initialize_key_node(new_node, NODE_LEAF);
+  *node_next(new_node) = *node_next(node);
+  *node_next(node) = new_page_num;
+  *node_prev(new_node) = page_num;
+  if (*node_next(new_node) != INVALID_PAGE_NUM) {
+    void* next_node = get_page(pager, *node_next(new_node));
+    *node_prev(next_node) = new_page_num;
+    mark_page_dirty(pager, next_node);
+  }
+
+  key_node_split(pager, node, new_node, key_node_split_point(node));
+  uint32_t last = *key_node_num_cells(node) - 1;
+  uint8_t separator[KEY_MAX_SIZE];
+  uint32_t separator_length = key_separator_length(
+      key_node_key(node, last), key_node_key_length(node, last), key_node_key(new_node, 0),
+      key_node_key_length(new_node, 0));
+  memcpy(separator, key_node_key(new_node, 0), separator_length);
+
+  void* destination = key_compare(key, length, separator, separator_length) < 0 ? node : new_node;
+  bool found;
+  uint32_t cell_num = key_node_find(destination, key, length, &found);
+  key_node_insert_cell(pager, destination, cell_num, key, length, value);
+  mark_page_dirty(pager, node);
+  mark_page_dirty(pager, new_node);
+
+  key_tree_insert_child(pager, root_page_num, path, path->depth - 1, separator,
+                        separator_length, new_page_num);
+}
+
+// Adds key with value. Returns false, changing nothing, when the key is
+// already in the tree.
+bool key_tree_insert(Pager* pager, uint32_t root_page_num, const uint8_t* key, uint32_t length,
+                     uint32_t value) {
+  if (length > KEY_MAX_SIZE) {
+    printf("Key of %d bytes is longer than %d.\n", length, KEY_MAX_SIZE);
+    exit(EXIT_FAILURE);
+  }
+  TreePath path;
+  uint32_t page_num = key_tree_descend(pager, root_page_num, key, length, &path);
+  void* node = get_page(pager, page_num);
+  bool found;
+  uint32_t cell_num = key_node_find(node, key, length, &found);
+  if (found) {
+    return false;
+  }
+  if (!key_node_has_room(pager, node, length)) {
+    key_tree_split_leaf(pager, root_page_num, &path, page_num, key, length, value);
+    return true;
+  }
+  key_node_insert_cell(pager, node, cell_num, key, length, value);
+  mark_page_dirty(pager, node);
+  return true;
+}
+
+// Removes key. A leaf left empty is freed and dropped from its parent, and so
+// on up for parents left without children. Once the root is down to a single
+// child, that child moves up into the root page. Returns false when the key
+// is not in the tree.
+bool key_tree_delete(Pager* pager, uint32_t root_page_num, const uint8_t* key,
+                     uint32_t length) {
+  TreePath path;
+  uint32_t page_num = key_tree_descend(pager, root_page_num, key, length, &path);
+  void* node = get_page(pager, page_num);
+  bool found;
+  uint32_t cell_num = key_node_find(node, key, length, &found);
+  if (!found) {
+    return false;
+  }
+  key_node_remove_cell(pager, node, cell_num);
+  mark_page_dirty(pager, node);
+
+  bool empty = *key_node_num_cells(node) == 0;
+  for (int32_t level = (int32_t)path.depth - 1; level >= 0 && empty; level--) {
+    void* parent = get_page(pager, path.page_nums[level]);
+    uint32_t num_cells = *key_node_num_cells(parent);
+    uint32_t index = path.child_indexes[level];
+    delete_page(pager, page_num);
+    page_num = path.page_nums[level];
+    if (num_cells == 0) {
+      // The parent's only child is gone. The root stays, as an empty leaf.
+      if (level == 0) {
+        initialize_key_node(parent, NODE_LEAF);
+        set_node_root(parent, true);
+        mark_page_dirty(pager, parent);
+      }
+      continue;
+    }
+    // Child index covered the keys from separator index - 1 to separator
+    // index; its neighbour takes over that range.
+    if (index == num_cells) {
+      *key_node_right_child(parent) = *key_node_payload(parent, num_cells - 1);
+      index = num_cells - 1;
+    }
+    key_node_remove_cell(pager, parent, index);
+    mark_page_dirty(pager, parent);
+    empty = false;
+  }
+
+  void* root = get_page(pager, root_page_num);
+  while (get_node_type(root) == NODE_INTERNAL && *key_node_num_cells(root) == 0) {
+    uint32_t child_page_num = *key_node_right_child(root);
+    memcpy(root, get_page(pager, child_page_num), pager->page_size);
+    set_node_root(root, true);
+    mark_page_dirty(pager, root);
+    set_page_used(pager, child_page_num, false);
+  }
+  return true;
+}
+
+// Frees every page of the tree, the root included.
+void key_tree_free(Pager* pager, uint32_t page_num) {
+  void* node = get_page(pager, page_num);
+  if (get_node_type(node) == NODE_INTERNAL) {
+    for (uint32_t i = 0; i <= *key_node_num_cells(node); i++) {
+      key_tree_free(pager, key_node_child(node, i));
+    }
+  }
+  unpin_page(pager, page_num);
+  set_page_used(pager, page_num, false);
+}
+
+// Moves the cursor to the first cell of the next leaf that has any. The
+// cursor keeps only a page number, and unpins each page once read, so a long
+// walk does not pin every leaf it passes.
+static void key_cursor_next_leaf(KeyCursor* cursor) {
+  void* node = get_page(cursor->pager, cursor->page_num);
+  unpin_page(cursor->pager, cursor->page_num);
+  while (cursor->cell_num >= *key_node_num_cells(node)) {
+    uint32_t next_page_num = *node_next(node);
+    if (next_page_num == INVALID_PAGE_NUM) {
+      cursor->end_of_tree = true;
+      return;
+    }
+    cursor->page_num = next_page_num;
+    cursor->cell_num = 0;
+    node = get_page(cursor->pager, next_page_num);
+    unpin_page(cursor->pager, next_page_num);
+  }
+}
+
+// Positions the cursor at the first key that is at least key.
+void key_tree_seek(Pager* pager, uint32_t root_page_num, const uint8_t* key, uint32_t length,
+                   KeyCursor* cursor) {
+  TreePath path;
+  cursor->pager = pager;
+  cursor->page_num = key_tree_descend(pager, root_page_num, key, length, &path);
+  cursor->end_of_tree = false;
+  bool found;
+  cursor->cell_num = key_node_find(get_page(pager, cursor->page_num), key, length, &found);
+  key_cursor_next_leaf(cursor);
+}
+
+// The key stays valid until the next page is fetched.
+uint8_t* key_cursor_key(KeyCursor* cursor, uint32_t* length) {
+  void* node = get_page(cursor->pager, cursor->page_num);
+  unpin_page(cursor->pager, cursor->page_num);
+  *length = key_node_key_length(node, cursor->cell_num);
+  return key_node_key(node, cursor->cell_num);
+}
+
+uint32_t key_cursor_value(KeyCursor* cursor) {
+  void* node = get_page(cursor->pager, cursor->page_num);
+  unpin_page(cursor->pager, cursor->page_num);
+  return *key_node_payload(node, cursor->cell_num);
+}
+
+void key_cursor_advance(KeyCursor* cursor) {
+  cursor->cell_num++;
+  key_cursor_next_leaf(cursor);
+}
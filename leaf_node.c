@@ -4,230 +4,396 @@ uint32_t* leaf_node_num_cells(void* node) {
   return node + LEAF_NODE_NUM_CELLS_OFFSET;
 }
 
-void* leaf_node_cell(void* node, uint32_t cell_num) {
-  return node + LEAF_NODE_HEADER_SIZE + cell_num * LEAF_NODE_CELL_SIZE;
+uint32_t* leaf_node_heap_size(void* node) {
+  return node + LEAF_NODE_HEAP_SIZE_OFFSET;
+}
+
+uint32_t* leaf_node_slot(void* node, uint32_t cell_num) {
+  return node + LEAF_NODE_HEADER_SIZE + cell_num * LEAF_NODE_SLOT_SIZE;
 }
 
 uint32_t* leaf_node_key(void* node, uint32_t cell_num) {
-  return leaf_node_cell(node, cell_num);
+  return (void*)leaf_node_slot(node, cell_num) + LEAF_NODE_OFFSET_SIZE;
 }
 
 void* leaf_node_value(void* node, uint32_t cell_num) {
-  return leaf_node_cell(node, cell_num) + LEAF_NODE_KEY_SIZE;
+  return node + *leaf_node_slot(node, cell_num);
 }
 
 void initialize_leaf_node(void* node) {
   set_node_type(node, NODE_LEAF);
   set_node_root(node, false);
   *leaf_node_num_cells(node) = 0;
+  *leaf_node_heap_size(node) = 0;
   *(node_next(node)) = INVALID_PAGE_NUM;
   *(node_prev(node)) = INVALID_PAGE_NUM;
 
 }
-Cursor* leaf_node_find(Table* table, uint32_t page_num, uint32_t key) {
+
+// Returns the bytes taken by the node's slots and values.
+uint32_t leaf_node_used_bytes(void* node) {
+  return *leaf_node_num_cells(node) * LEAF_NODE_SLOT_SIZE + *leaf_node_heap_size(node);
+}
+
+// Returns whether a value of value_size bytes, and its slot, fit in node.
+bool leaf_node_has_room(Pager* pager, void* node, uint32_t value_size) {
+  return *leaf_node_num_cells(node) < LEAF_NODE_MAX_CELLS(pager) &&
+         leaf_node_used_bytes(node) + LEAF_NODE_SLOT_SIZE + value_size <=
+             LEAF_NODE_SPACE_FOR_CELLS(pager);
+}
+
+// A leaf is underfull once it is below half the page and below half its
+// cells; the cell count only matters for the small test fan-out.
+static bool leaf_node_underfull(Pager* pager, void* node) {
+  return *leaf_node_num_cells(node) < LEAF_NODE_MIN_CELLS(pager) &&
+         leaf_node_used_bytes(node) < LEAF_NODE_SPACE_FOR_CELLS(pager) / 2;
+}
+
+// Returns whether right's cells fit in left.
+static bool leaf_nodes_fit(Pager* pager, void* left, void* right) {
+  return *leaf_node_num_cells(left) + *leaf_node_num_cells(right) <= LEAF_NODE_MAX_CELLS(pager) &&
+         leaf_node_used_bytes(left) + leaf_node_used_bytes(right) <=
+             LEAF_NODE_SPACE_FOR_CELLS(pager);
+}
+
+// Adds a slot for key at cell_num and value_size bytes for its value at the
+// bottom of the heap, and returns where the value goes. The caller has
+// checked that the leaf has room.
+void* leaf_node_insert_cell(Pager* pager, void* node, uint32_t cell_num, uint32_t key,
+                            uint32_t value_size) {
+  uint32_t num_cells = *leaf_node_num_cells(node);
+  memmove(leaf_node_slot(node, cell_num + 1), leaf_node_slot(node, cell_num),
+          (num_cells - cell_num) * LEAF_NODE_SLOT_SIZE);
+  *leaf_node_heap_size(node) += value_size;
+  *leaf_node_slot(node, cell_num) = pager->page_size - *leaf_node_heap_size(node);
+  *leaf_node_key(node, cell_num) = key;
+  *leaf_node_num_cells(node) = num_cells + 1;
+  return leaf_node_value(node, cell_num);
+}
+
+// Removes count cells starting at cell_num. The values below each removed
+// value move up over it, so the heap stays packed and the free space stays in
+// one piece between the slots and the heap.
+void leaf_node_remove_cells(Pager* pager, void* node, uint32_t cell_num, uint32_t count) {
+  uint32_t num_cells = *leaf_node_num_cells(node);
+  for (uint32_t i = cell_num; i < cell_num + count; i++) {
+    uint32_t hole = *leaf_node_slot(node, i);
+    uint32_t size = serialized_value_size(node + hole);
+    uint32_t bottom = pager->page_size - *leaf_node_heap_size(node);
+    memmove(node + bottom + size, node + bottom, hole - bottom);
+    for (uint32_t j = 0; j < num_cells; j++) {
+      if (*leaf_node_slot(node, j) < hole) {
+        *leaf_node_slot(node, j) += size;
+      }
+    }
+    *leaf_node_heap_size(node) -= size;
+  }
+  memmove(leaf_node_slot(node, cell_num), leaf_node_slot(node, cell_num + count),
+          (num_cells - cell_num - count) * LEAF_NODE_SLOT_SIZE);
+  *leaf_node_num_cells(node) = num_cells - count;
+}
+
+// Copies count cells of source, from source_cell on, into destination at
+// destination_cell. source is left as it was.
+void leaf_node_move_cells(Pager* pager, void* destination, uint32_t destination_cell,
+                          void* source, uint32_t source_cell, uint32_t count) {
+  for (uint32_t i = 0; i < count; i++) {
+    void* source_value = leaf_node_value(source, source_cell + i);
+    uint32_t size = serialized_value_size(source_value);
+    void* value = leaf_node_insert_cell(pager, destination, destination_cell + i,
+                                        *leaf_node_key(source, source_cell + i), size);
+    memcpy(value, source_value, size);
+  }
+}
+
+void leaf_node_find(Table* table, uint32_t page_num, uint32_t key, Cursor* cursor) {
   void* node = get_page(table->pager, page_num);
   uint32_t num_cells = *leaf_node_num_cells(node);
 
-  Cursor* cursor = malloc(sizeof(Cursor));
   cursor->table = table;
   cursor->page_num = page_num;
   cursor->end_of_table = false;
+  cursor->readahead_window = 0;
+  cursor->readahead_ahead = 0;
+  cursor->cell_num = key_search(leaf_node_slot(node, 0), num_cells, key);
+}
 
-  uint32_t min_index = 0;
-  uint32_t one_past_max_index = num_cells;
-  while (one_past_max_index != min_index) {
-    uint32_t index = (min_index + one_past_max_index) / 2;
-    uint32_t key_at_index = *leaf_node_key(node, index);
-    if (key == key_at_index) {
-      cursor->cell_num = index;
-      return cursor;
-    }
-    if (key < key_at_index) {
-      one_past_max_index = index;
+// Spreads the cells of node, with the new row going in at cell_num, over node
+// and its new, empty right sibling so that both hold about the same bytes.
+static void leaf_node_split_cells(Pager* pager, void* node, void* right, uint32_t cell_num,
+                                  uint32_t key, Row* value, uint32_t value_size) {
+  uint32_t num_cells = *leaf_node_num_cells(node);
+  void* old_node = malloc(pager->page_size);
+  memcpy(old_node, node, pager->page_size);
+  *leaf_node_num_cells(node) = 0;
+  *leaf_node_heap_size(node) = 0;
+
+  // A cell stays on the left while its middle byte is in the left half.
+  // Cell i of the num_cells + 1 is the new row at cell_num, or else old cell
+  // i or i - 1.
+  uint32_t total = leaf_node_used_bytes(old_node) + LEAF_NODE_SLOT_SIZE + value_size;
+  uint32_t split = 0;
+  uint32_t left_bytes = 0;
+  while (split < num_cells) {
+    uint32_t size = LEAF_NODE_SLOT_SIZE;
+    if (split == cell_num) {
+      size += value_size;
     } else {
-      min_index = index + 1;
+      size += serialized_value_size(leaf_node_value(old_node, split - (split > cell_num)));
     }
+    if (split > 0 && 2 * left_bytes + size > total) {
+      break;
+    }
+    left_bytes += size;
+    split++;
+  }
+  if (split > LEAF_NODE_MAX_CELLS(pager)) {
+    split = LEAF_NODE_MAX_CELLS(pager);
+  }
+  if (num_cells + 1 - split > LEAF_NODE_MAX_CELLS(pager)) {
+    split = num_cells + 1 - LEAF_NODE_MAX_CELLS(pager);
   }
 
-  cursor->cell_num = min_index;
-  return cursor;
+  for (uint32_t i = 0; i <= num_cells; i++) {
+    void* destination = i < split ? node : right;
+    uint32_t destination_cell = i < split ? i : i - split;
+    if (i == cell_num) {
+      serialize_row(value, leaf_node_insert_cell(pager, destination, destination_cell, key,
+                                                 value_size));
+    } else {
+      leaf_node_move_cells(pager, destination, destination_cell, old_node, i - (i > cell_num), 1);
+    }
+  }
+  free(old_node);
 }
 
 void leaf_node_split_and_insert(Cursor* cursor, uint32_t key, Row* value) {
+  Pager* pager = cursor->table->pager;
+  TreePath* path = &cursor->path;
+  cursor->table->tree_version++;
+  if (path->depth == 0) {
+    cursor->page_num = create_new_root(cursor->table, path);
+  }
 
-  void* old_node = get_page(cursor->table->pager, cursor->page_num);
-  uint32_t old_max = get_node_max_key(cursor->table->pager, old_node);
-  uint32_t new_page_num = get_unused_page_num(cursor->table->pager);
-  void* new_node = get_page(cursor->table->pager, new_page_num);
+  void* old_node = get_page(pager, cursor->page_num);
+  // A key past the end of the rightmost leaf most likely comes from ids that
+  // only grow. Rather than leave a half empty leaf behind, the old leaf stays
+  // full and the new one starts with just this row.
+  bool append = cursor->cell_num == *leaf_node_num_cells(old_node) &&
+                *node_next(old_node) == INVALID_PAGE_NUM;
+  uint32_t new_page_num = get_unused_page_num(pager);
+  void* new_node = get_page(pager, new_page_num);
   initialize_leaf_node(new_node);
-  *node_parent(new_node) = *node_parent(old_node);
   *node_next(new_node) = *node_next(old_node);
   *node_next(old_node) = new_page_num;
-  *node_prev  (new_node) = cursor->page_num;
-
-  for (int32_t i = LEAF_NODE_MAX_CELLS; i >= 0; i--) {
-    void* destination_node;
-    if (i >= LEAF_NODE_LEFT_SPLIT_COUNT) {
-      destination_node = new_node;
-    } else {
-      destination_node = old_node;
-    }
-    uint32_t index_within_node = i % LEAF_NODE_LEFT_SPLIT_COUNT;
-    void* destination = leaf_node_cell(destination_node, index_within_node);
-
-    if (i == cursor->cell_num) {
-      serialize_row(value,
-                    leaf_node_value(destination_node, index_within_node));
-      *leaf_node_key(destination_node, index_within_node) = key;
-    } else if (i > cursor->cell_num) {
-      memcpy(destination, leaf_node_cell(old_node, i - 1), LEAF_NODE_CELL_SIZE);
-    } else {
-      memcpy(destination, leaf_node_cell(old_node, i), LEAF_NODE_CELL_SIZE);
-    }
+  *node_prev(new_node) = cursor->page_num;
+  if (*node_next(new_node) != INVALID_PAGE_NUM) {
+    void* next_node = get_page(pager, *node_next(new_node));
+    *node_prev(next_node) = new_page_num;
+    mark_page_dirty(pager, next_node);
   }
-  *(leaf_node_num_cells(old_node)) = LEAF_NODE_LEFT_SPLIT_COUNT;
-  *(leaf_node_num_cells(new_node)) = LEAF_NODE_RIGHT_SPLIT_COUNT;
-  if (is_node_root(old_node)) {
 
-    return create_new_root(cursor->table, new_page_num);
+  uint32_t value_size = serialized_row_size(value);
+  if (append) {
+    serialize_row(value, leaf_node_insert_cell(pager, new_node, 0, key, value_size));
   } else {
-    uint32_t parent_page_num = *node_parent(old_node);
-    uint32_t new_max = get_node_max_key(cursor->table->pager, old_node);
-    void* parent = get_page(cursor->table->pager, parent_page_num);
-
-    update_internal_node_key(parent, old_max, new_max);
-    internal_node_insert(cursor->table, parent_page_num, new_page_num);
-    return;
+    leaf_node_split_cells(pager, old_node, new_node, cursor->cell_num, key, value, value_size);
   }
+  mark_page_dirty(pager, old_node);
+  mark_page_dirty(pager, new_node);
+
+  uint32_t old_max = *leaf_node_key(old_node, *leaf_node_num_cells(old_node) - 1);
+  internal_node_insert(cursor->table, path, path->depth - 1, old_max, new_page_num, append);
 }
 
 void leaf_node_insert(Cursor* cursor, uint32_t key, Row* value) {
-  void* node = get_page(cursor->table->pager, cursor->page_num);
-  uint32_t num_cells = *leaf_node_num_cells(node);
-  if (num_cells >= LEAF_NODE_MAX_CELLS) {
-
+  Pager* pager = cursor->table->pager;
+  void* node = get_page(pager, cursor->page_num);
+  uint32_t value_size = serialized_row_size(value);
+  if (!leaf_node_has_room(pager, node, value_size)) {
     leaf_node_split_and_insert(cursor, key, value);
     return;
   }
 
-  if (cursor->cell_num < num_cells) {
+  serialize_row(value, leaf_node_insert_cell(pager, node, cursor->cell_num, key, value_size));
+  mark_page_dirty(pager, node);
+}
 
-    for (uint32_t i = num_cells; i > cursor->cell_num; i--) {
-      memcpy(leaf_node_cell(node, i), leaf_node_cell(node, i - 1),LEAF_NODE_CELL_SIZE);
-    }
+// Replaces the row at the cursor with value, whose id belongs in the same
+// leaf at new_cell_num, counted with the old row still in place. No other
+// leaf and no separator changes. A value of the same size is written over
+// the old one and only its slot moves; otherwise the old value is removed
+// and the new one added at the bottom of the heap. Returns false, changing
+// nothing, when a bigger value does not fit in the leaf.
+bool leaf_node_update(Cursor* cursor, uint32_t new_cell_num, Row* value) {
+  Pager* pager = cursor->table->pager;
+  void* node = get_page(pager, cursor->page_num);
+  uint32_t cell_num = cursor->cell_num;
+  uint32_t old_size = serialized_value_size(leaf_node_value(node, cell_num));
+  uint32_t new_size = serialized_row_size(value);
+  if (new_size > old_size &&
+      leaf_node_used_bytes(node) + new_size - old_size > LEAF_NODE_SPACE_FOR_CELLS(pager)) {
+    return false;
+  }
+  if (new_cell_num > cell_num) {
+    new_cell_num--;
   }
 
-  *(leaf_node_num_cells(node)) += 1;
-  *(leaf_node_key(node, cursor->cell_num)) = key;
-  serialize_row(value, leaf_node_value(node, cursor->cell_num));
-}
-
-void borrow_from_right_leaf(void * node, void* right, void* par){
-  
-  uint32_t ind = *leaf_node_num_cells(node);
-  uint32_t old_max;
-  for(uint32_t i= 0; i<*internal_node_num_keys(par);i++){
-    if(*internal_node_child(par,i) == *node_prev(right)){
-      old_max = *internal_node_key(par,i);
-      break;
+  if (new_size == old_size) {
+    uint32_t offset = *leaf_node_slot(node, cell_num);
+    if (new_cell_num < cell_num) {
+      memmove(leaf_node_slot(node, new_cell_num + 1), leaf_node_slot(node, new_cell_num),
+              (cell_num - new_cell_num) * LEAF_NODE_SLOT_SIZE);
+    } else {
+      memmove(leaf_node_slot(node, cell_num), leaf_node_slot(node, cell_num + 1),
+              (new_cell_num - cell_num) * LEAF_NODE_SLOT_SIZE);
     }
+    *leaf_node_slot(node, new_cell_num) = offset;
+    *leaf_node_key(node, new_cell_num) = value->id;
+    serialize_row(value, node + offset);
+  } else {
+    leaf_node_remove_cells(pager, node, cell_num, 1);
+    serialize_row(value, leaf_node_insert_cell(pager, node, new_cell_num, value->id, new_size));
   }
-  *leaf_node_num_cells(node) +=1;
-  memcpy(leaf_node_cell(node,ind),leaf_node_cell(right,0),LEAF_NODE_CELL_SIZE);
-  uint32_t num_cell_r = *leaf_node_num_cells(right);
-  for(uint32_t i=1;i<num_cell_r;i++){
-    memcpy(leaf_node_cell(right,i-1),leaf_node_cell(right,i),LEAF_NODE_CELL_SIZE);
-  }
-  *leaf_node_num_cells(right) -=1;
-  uint32_t new_max = *leaf_node_key(node, *leaf_node_num_cells(node) - 1);
-  update_internal_node_key(par,old_max,new_max);  
+  cursor->cell_num = new_cell_num;
+  mark_page_dirty(pager, node);
+  return true;
 }
 
-void borrow_from_left_leaf(void * node, void* left,void* par){
-  
-  uint32_t ind = *leaf_node_num_cells(left);
-  uint32_t old_max;
-  for(uint32_t i= 0; i<*internal_node_num_keys(par);i++){
-    if(*internal_node_child(par,i) == *node_prev(node)){
-      old_max = *internal_node_key(par,i);
-      break;
+// Merges a sorted run of rows that all belong in the cursor's leaf, the
+// first of them at cursor->cell_num. The merge runs from the back, so each
+// slot already in the leaf moves at most once for the whole run. Stops at
+// the first row the leaf has no room for; rows whose id is already in the
+// leaf are skipped and set to NULL in run. Returns how many rows of the run
+// were used up.
+uint32_t leaf_node_insert_run(Cursor* cursor, Row** run, uint32_t count) {
+  Pager* pager = cursor->table->pager;
+  void* node = get_page(pager, cursor->page_num);
+  uint32_t num_cells = *leaf_node_num_cells(node);
+  uint32_t free_cells = LEAF_NODE_MAX_CELLS(pager) - num_cells;
+  uint32_t free_bytes = LEAF_NODE_SPACE_FOR_CELLS(pager) - leaf_node_used_bytes(node);
+
+  uint32_t consumed = 0;
+  uint32_t taken = 0;
+  uint32_t cell = cursor->cell_num;
+  while (consumed < count) {
+    uint32_t id = run[consumed]->id;
+    while (cell < num_cells && *leaf_node_key(node, cell) < id) {
+      cell++;
+    }
+    if (cell == num_cells || *leaf_node_key(node, cell) != id) {
+      uint32_t size = LEAF_NODE_SLOT_SIZE + serialized_row_size(run[consumed]);
+      if (taken == free_cells || size > free_bytes) {
+        break;
+      }
+      free_bytes -= size;
+      taken++;
     }
+    consumed++;
   }
-  uint32_t num_cell_r = *leaf_node_num_cells(node);
-  *leaf_node_num_cells(node) +=1;
-  for(uint32_t i=0;i<num_cell_r;i++){
-    memcpy(leaf_node_cell(node,i+1),leaf_node_cell(node,i),LEAF_NODE_CELL_SIZE);
+
+  int32_t source = (int32_t)num_cells - 1;
+  uint32_t destination = num_cells + taken;
+  for (uint32_t i = consumed; i > 0; i--) {
+    uint32_t id = run[i - 1]->id;
+    while (source >= 0 && *leaf_node_key(node, source) > id) {
+      memcpy(leaf_node_slot(node, --destination), leaf_node_slot(node, source--),
+             LEAF_NODE_SLOT_SIZE);
+    }
+    if (source >= 0 && *leaf_node_key(node, source) == id) {
+      run[i - 1] = NULL;
+      continue;
+    }
+    destination--;
+    *leaf_node_heap_size(node) += serialized_row_size(run[i - 1]);
+    *leaf_node_slot(node, destination) = pager->page_size - *leaf_node_heap_size(node);
+    *leaf_node_key(node, destination) = id;
+    serialize_row(run[i - 1], leaf_node_value(node, destination));
   }
-  memcpy(leaf_node_cell(node,0),leaf_node_cell(left,ind-1),LEAF_NODE_CELL_SIZE);
-  *leaf_node_num_cells(left) -=1;
-  uint32_t new_max = *leaf_node_key(node, *leaf_node_num_cells(left) - 1);
-  update_internal_node_key(par,old_max,new_max);  
+  *leaf_node_num_cells(node) = num_cells + taken;
+  mark_page_dirty(pager, node);
+  return consumed;
 }
 
-void merge_leaf(void* node, void* left,void* par, Table* table){
-  uint32_t num = *leaf_node_num_cells(left);
-  uint32_t num2 = *leaf_node_num_cells(node);
-  *leaf_node_num_cells(node)+=num;
+// Moves right's first cell over to the end of node. index is node's position
+// in parent.
+void borrow_from_right_leaf(Pager* pager, void* node, void* right, void* parent,
+                            uint32_t index) {
+  uint32_t num_cells = *leaf_node_num_cells(node);
+  leaf_node_move_cells(pager, node, num_cells, right, 0, 1);
+  leaf_node_remove_cells(pager, right, 0, 1);
 
-  uint32_t old_max = get_node_max_key(table->pager,left);
-  for(uint32_t i=num2;i>0;i--){
-    memcpy(leaf_node_cell(node,i+num-1),leaf_node_cell(node,i-1),LEAF_NODE_CELL_SIZE);
-  }
+  *internal_node_key(parent, index) = *leaf_node_key(node, num_cells);
+  mark_page_dirty(pager, node);
+  mark_page_dirty(pager, right);
+  mark_page_dirty(pager, parent);
+}
 
-  for(uint32_t i=0;i<num;i++){
-    memcpy(leaf_node_cell(node,i),leaf_node_cell(left,i),LEAF_NODE_CELL_SIZE);
-  }
-  delete_page(table->pager,*node_prev(node));
-  if(is_node_root(par)){
-    delete_from_root(table,old_max);
-  }
-  else{
-    delete_from_internal(table,*node_parent(node),old_max);
-  }
+// Moves left's last cell over to the front of node. index is node's position
+// in parent.
+void borrow_from_left_leaf(Pager* pager, void* node, void* left, void* parent,
+                           uint32_t index) {
+  uint32_t left_num_cells = *leaf_node_num_cells(left);
+  leaf_node_move_cells(pager, node, 0, left, left_num_cells - 1, 1);
+  leaf_node_remove_cells(pager, left, left_num_cells - 1, 1);
+
+  *internal_node_key(parent, index - 1) = *leaf_node_key(left, left_num_cells - 2);
+  mark_page_dirty(pager, node);
+  mark_page_dirty(pager, left);
+  mark_page_dirty(pager, parent);
 }
 
-void delete_from_leaf(Cursor* cursor){
-  void* node = get_page(cursor->table->pager,cursor->page_num);
-  uint32_t num_cell = *leaf_node_num_cells(node);
-  for(uint32_t i=cursor->cell_num+1;i<num_cell;i++){
-    memcpy(leaf_node_cell(node,i-1),leaf_node_cell(node,i),LEAF_NODE_CELL_SIZE);
-  }
-  *leaf_node_num_cells(node)-=1;
-  if(is_node_root(node)){
+// Appends right's cells to left, its neighbour at index in the leaves'
+// parent, and frees right.
+void merge_leaf(Table* table, TreePath* path, void* left, void* right, uint32_t index) {
+  uint32_t level = path->depth - 1;
+  void* parent = get_page(table->pager, path->page_nums[level]);
+  uint32_t num_cells = *leaf_node_num_cells(left);
+  uint32_t right_num_cells = *leaf_node_num_cells(right);
+
+  leaf_node_move_cells(table->pager, left, num_cells, right, 0, right_num_cells);
+  mark_page_dirty(table->pager, left);
+
+  delete_page(table->pager, *internal_node_child(parent, index + 1));
+  delete_from_internal(table, path, level, index);
+}
+
+void delete_from_leaf(Cursor* cursor) {
+  Pager* pager = cursor->table->pager;
+  TreePath* path = &cursor->path;
+  void* node = get_page(pager, cursor->page_num);
+  leaf_node_remove_cells(pager, node, cursor->cell_num, 1);
+  mark_page_dirty(pager, node);
+
+  // With lazy deletes a leaf is only merged away once it is empty, which
+  // always fits in a sibling; sparse leaves are left to table_compact().
+  bool underflow = cursor->table->lazy_deletes ? *leaf_node_num_cells(node) == 0
+                                               : leaf_node_underfull(pager, node);
+  if (path->depth == 0 || !underflow) {
     return;
   }
-  if(*leaf_node_num_cells(node)<LEAF_NODE_MIN_CELLS){
-    uint32_t left_pg_num = *node_prev(node);
-    uint32_t right_pg_num = *node_next(node);
-    uint32_t par_pg_num = *node_parent(node);
-    
-    void * left = NULL;
-    void * right = NULL;
-    void * par = NULL;
-    if(left_pg_num!=INVALID_PAGE_NUM){
-      left = get_page(cursor->table->pager,left_pg_num);
-    }
-    if(right_pg_num!=INVALID_PAGE_NUM){
-      right = get_page(cursor->table->pager,right_pg_num);
-    }
-    if(par_pg_num!=INVALID_PAGE_NUM){
-      par = get_page(cursor->table->pager,par_pg_num);
-    }
-    if((left!=NULL)&&(*leaf_node_num_cells(left)>LEAF_NODE_MIN_CELLS)&&(*node_parent(left)==*node_parent(node))){
-      borrow_from_left_leaf(node,left,par);
-    }
-    else if((right!=NULL)&&(*leaf_node_num_cells(right)>LEAF_NODE_MIN_CELLS)&&(*node_parent(right)==*node_parent(node))){
-      borrow_from_right_leaf(node,right,par);
-    }
-    else if((left!=NULL)&&(*node_parent(left)==*node_parent(node))){
-      merge_leaf(node,left,par,cursor->table);
-    }
-    else if((right!=NULL)&&(*node_parent(right)==*node_parent(node))){
-      merge_leaf(right,node,par,cursor->table);
-    }
-    else{
-      printf("Error Deleting.\n");
-      exit(EXIT_FAILURE);
-    }
+  cursor->table->tree_version++;
+
+  void* parent = get_page(pager, path->page_nums[path->depth - 1]);
+  uint32_t index = path->child_indexes[path->depth - 1];
+  void* left = NULL;
+  void* right = NULL;
+  if (index > 0) {
+    left = get_page(pager, *internal_node_child(parent, index - 1));
   }
-}
\ No newline at end of file
+  if (index < *internal_node_num_keys(parent)) {
+    right = get_page(pager, *internal_node_child(parent, index + 1));
+  }
+
+  // A sibling that cannot take in node's cells is over half full, so it can
+  // spare one.
+  if (left != NULL && leaf_nodes_fit(pager, left, node)) {
+    merge_leaf(cursor->table, path, left, node, index - 1);
+  } else if (right != NULL && leaf_nodes_fit(pager, node, right)) {
+    merge_leaf(cursor->table, path, node, right, index);
+  } else if (left != NULL) {
+    borrow_from_left_leaf(pager, node, left, parent, index);
+  } else {
+    borrow_from_right_leaf(pager, node, right, parent, index);
+  }
+}
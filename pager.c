@@ -1,6 +1,246 @@
 #include "define.h"
 
-Pager* pager_open(const char* filename) {
+static void page_table_init(PageTable* table, uint32_t capacity) {
+  table->capacity = PAGE_TABLE_MIN_CAPACITY;
+  table->shift = 32 - __builtin_ctz(PAGE_TABLE_MIN_CAPACITY);
+  while (table->capacity < capacity) {
+    table->capacity *= 2;
+    table->shift--;
+  }
+  table->page_nums = malloc(table->capacity * sizeof(uint32_t));
+  table->frame_nums = malloc(table->capacity * sizeof(uint32_t));
+  memset(table->page_nums, 0xff, table->capacity * sizeof(uint32_t));
+  table->count = 0;
+}
+
+static uint32_t page_table_slot(PageTable* table, uint32_t page_num) {
+  return (page_num * 2654435761u) >> table->shift;
+}
+
+static uint32_t page_table_lookup(PageTable* table, uint32_t page_num) {
+  uint32_t mask = table->capacity - 1;
+  for (uint32_t i = page_table_slot(table, page_num);; i = (i + 1) & mask) {
+    if (table->page_nums[i] == page_num) {
+      return table->frame_nums[i];
+    }
+    if (table->page_nums[i] == INVALID_PAGE_NUM) {
+      return INVALID_FRAME_NUM;
+    }
+  }
+}
+
+static void page_table_insert(PageTable* table, uint32_t page_num, uint32_t frame_num) {
+  if ((table->count + 1) * 2 > table->capacity) {
+    PageTable grown;
+    page_table_init(&grown, table->capacity * 2);
+    for (uint32_t i = 0; i < table->capacity; i++) {
+      if (table->page_nums[i] != INVALID_PAGE_NUM) {
+        page_table_insert(&grown, table->page_nums[i], table->frame_nums[i]);
+      }
+    }
+    free(table->page_nums);
+    free(table->frame_nums);
+    *table = grown;
+  }
+  uint32_t mask = table->capacity - 1;
+  uint32_t i = page_table_slot(table, page_num);
+  while (table->page_nums[i] != INVALID_PAGE_NUM && table->page_nums[i] != page_num) {
+    i = (i + 1) & mask;
+  }
+  if (table->page_nums[i] == INVALID_PAGE_NUM) {
+    table->count++;
+  }
+  table->page_nums[i] = page_num;
+  table->frame_nums[i] = frame_num;
+}
+
+// Removes without tombstones: later entries of the probe run are shifted back
+// into the hole whenever their home slot allows it.
+static void page_table_remove(PageTable* table, uint32_t page_num) {
+  uint32_t mask = table->capacity - 1;
+  uint32_t hole = page_table_slot(table, page_num);
+  while (table->page_nums[hole] != page_num) {
+    if (table->page_nums[hole] == INVALID_PAGE_NUM) {
+      return;
+    }
+    hole = (hole + 1) & mask;
+  }
+  for (uint32_t i = (hole + 1) & mask; table->page_nums[i] != INVALID_PAGE_NUM;
+       i = (i + 1) & mask) {
+    uint32_t home = page_table_slot(table, table->page_nums[i]);
+    if (((i - home) & mask) >= ((i - hole) & mask)) {
+      table->page_nums[hole] = table->page_nums[i];
+      table->frame_nums[hole] = table->frame_nums[i];
+      hole = i;
+    }
+  }
+  table->page_nums[hole] = INVALID_PAGE_NUM;
+  table->count--;
+}
+
+static void page_table_clear(PageTable* table) {
+  memset(table->page_nums, 0xff, table->capacity * sizeof(uint32_t));
+  table->count = 0;
+}
+
+static void mmap_grow(Pager* pager, uint32_t page_num) {
+  uint64_t pages = ((uint64_t)page_num / MMAP_GROW_PAGES + 1) * MMAP_GROW_PAGES;
+  if (pages > pager->map_reserved_pages) {
+    pages = pager->map_reserved_pages;
+  }
+  if (page_num >= pages) {
+    printf("Db file is too large for the address space reserved by the mmap backend.\n");
+    exit(EXIT_FAILURE);
+  }
+  if (ftruncate(pager->file_descriptor, (off_t)pages * pager->page_size) == -1) {
+    printf("Error growing db file: %d\n", errno);
+    exit(EXIT_FAILURE);
+  }
+  pager->map_dirty = realloc(pager->map_dirty, pages * sizeof(bool));
+  memset(pager->map_dirty + pager->mapped_pages, 0, pages - pager->mapped_pages);
+  pager->mapped_pages = pages;
+}
+
+// The largest address range the db file could need is mapped once up front
+// and the file is grown underneath it with ftruncate(), so page pointers
+// handed out by get_page() stay valid for as long as the db is open. Where
+// the address space is too small for every possible page the reservation is
+// halved until it fits.
+static void mmap_open(Pager* pager) {
+#ifdef HAVE_MMAP
+  pager->map_reserved_pages = DB_MAX_PAGES;
+  pager->map = MAP_FAILED;
+  while (pager->map == MAP_FAILED && pager->map_reserved_pages >= MMAP_MIN_RESERVE_PAGES) {
+    pager->map = mmap(NULL, pager->map_reserved_pages * pager->page_size, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_NORESERVE, pager->file_descriptor, 0);
+    if (pager->map == MAP_FAILED) {
+      pager->map_reserved_pages /= 2;
+    }
+  }
+  if (pager->map == MAP_FAILED ||
+      (uint64_t)pager->file_length / pager->page_size > pager->map_reserved_pages) {
+    printf("Error mapping db file: %d\n", errno);
+    exit(EXIT_FAILURE);
+  }
+  pager->mapped_pages = pager->file_length / pager->page_size;
+  pager->map_dirty = calloc(pager->mapped_pages, sizeof(bool));
+  if (pager->mapped_pages == 0) {
+    mmap_grow(pager, 0);
+  }
+#endif
+}
+
+// msyncs each run of adjacent dirty pages with one call.
+static uint32_t mmap_flush_all(Pager* pager) {
+  uint32_t flushed = 0;
+  pager->map_dirty[0] = pager->header_dirty;
+  pager->header_dirty = false;
+  uint32_t page_num = 0;
+  while (page_num < pager->mapped_pages) {
+    if (!pager->map_dirty[page_num]) {
+      page_num++;
+      continue;
+    }
+    uint32_t run_start = page_num;
+    while (page_num < pager->mapped_pages && pager->map_dirty[page_num]) {
+      pager->map_dirty[page_num++] = false;
+    }
+#ifdef HAVE_MMAP
+    if (msync(pager->map + (size_t)run_start * pager->page_size,
+              (size_t)(page_num - run_start) * pager->page_size, MS_SYNC) == -1) {
+      printf("Error syncing mapped pages: %d\n", errno);
+      exit(EXIT_FAILURE);
+    }
+#endif
+    flushed += page_num - run_start;
+  }
+  pager->pages_written += flushed;
+  return flushed;
+}
+
+// Files written before the free map kept one byte per page right after the
+// root page number. The byte map is turned into the bitmap layout in place.
+static void upgrade_header(Pager* pager) {
+  uint32_t old_max_pages = DEFAULT_PAGE_SIZE - sizeof(uint32_t);
+  uint8_t* old_map = malloc(old_max_pages);
+  memcpy(old_map, pager->page_used + sizeof(uint32_t), old_max_pages);
+  memset(pager->page_used + sizeof(uint32_t), 0, DEFAULT_PAGE_SIZE - sizeof(uint32_t));
+
+  uint32_t* header = pager->page_used;
+  header[HEADER_MAGIC_OFFSET / sizeof(uint32_t)] = DB_MAGIC;
+  set_page_used(pager, 0, true);
+  for (uint32_t i = 1; i < old_max_pages; i++) {
+    if (old_map[i]) {
+      set_page_used(pager, i, true);
+    }
+  }
+  free(old_map);
+}
+
+// Reads the page size and fan-out of an existing file from its header. Files
+// from before version 2 were always 4 KB pages with the test fan-out. Leaves
+// from before version 4 are left to table_upgrade_leaves(), which also sets
+// the fan-out for the current leaf layout.
+static void read_page_format(Pager* pager, DbOptions* options) {
+  pager->leaf_version = DB_VERSION;
+  if (pager->file_length == 0) {
+    pager->page_size = options->page_size;
+    if (options->test_fanout) {
+      pager->leaf_max_cells = TEST_FANOUT;
+      pager->internal_max_keys = TEST_FANOUT;
+    } else {
+      pager->leaf_max_cells = LEAF_NODE_SPACE_FOR_CELLS(pager) / LEAF_NODE_MIN_CELL_SIZE;
+      pager->internal_max_keys = INTERNAL_NODE_SPACE_FOR_CELLS(pager) / INTERNAL_NODE_CELL_SIZE;
+    }
+    return;
+  }
+
+  uint32_t header[FREE_MAP_OFFSET / sizeof(uint32_t)];
+  if (pread(pager->file_descriptor, header, sizeof(header), 0) != sizeof(header)) {
+    printf("Error reading file: %d\n", errno);
+    exit(EXIT_FAILURE);
+  }
+  uint32_t version = header[HEADER_VERSION_OFFSET / sizeof(uint32_t)];
+  if (header[HEADER_MAGIC_OFFSET / sizeof(uint32_t)] != DB_MAGIC || version < 2) {
+    pager->page_size = DEFAULT_PAGE_SIZE;
+    pager->leaf_max_cells = TEST_FANOUT;
+    pager->internal_max_keys = TEST_FANOUT;
+    pager->leaf_version = 1;
+    return;
+  }
+  if (version > DB_VERSION) {
+    printf("Db file version %d is newer than this program supports.\n", version);
+    exit(EXIT_FAILURE);
+  }
+  pager->leaf_version = version;
+  uint32_t cell_size = LEAF_NODE_MIN_CELL_SIZE;
+  if (version < 3) {
+    cell_size = LEGACY_LEAF_NODE_CELL_SIZE;
+  } else if (version < 4) {
+    cell_size = FIXED_LEAF_NODE_CELL_SIZE;
+  }
+  pager->page_size = header[HEADER_PAGE_SIZE_OFFSET / sizeof(uint32_t)];
+  pager->leaf_max_cells = header[HEADER_LEAF_MAX_CELLS_OFFSET / sizeof(uint32_t)];
+  pager->internal_max_keys = header[HEADER_INTERNAL_MAX_KEYS_OFFSET / sizeof(uint32_t)];
+  if (pager->page_size < MIN_PAGE_SIZE || pager->page_size > MAX_PAGE_SIZE ||
+      pager->leaf_max_cells * cell_size > LEAF_NODE_SPACE_FOR_CELLS(pager) ||
+      pager->internal_max_keys * INTERNAL_NODE_CELL_SIZE > INTERNAL_NODE_SPACE_FOR_CELLS(pager)) {
+    printf("Db file header is corrupt.\n");
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Brings the header up to the current version, recording the page format.
+void write_page_format(Pager* pager) {
+  uint32_t* header = pager->page_used;
+  header[HEADER_VERSION_OFFSET / sizeof(uint32_t)] = DB_VERSION;
+  header[HEADER_PAGE_SIZE_OFFSET / sizeof(uint32_t)] = pager->page_size;
+  header[HEADER_LEAF_MAX_CELLS_OFFSET / sizeof(uint32_t)] = pager->leaf_max_cells;
+  header[HEADER_INTERNAL_MAX_KEYS_OFFSET / sizeof(uint32_t)] = pager->internal_max_keys;
+  mark_page_dirty(pager, pager->page_used);
+}
+
+Pager* pager_open(const char* filename, DbOptions* options) {
   int fd = open(filename,
                 O_RDWR |     
                     O_CREAT, 
@@ -12,138 +252,732 @@ Pager* pager_open(const char* filename) {
     printf("Unable to open file\n");
     exit(EXIT_FAILURE);
   }
+  wal_recover(filename, fd);
   off_t file_length = lseek(fd, 0, SEEK_END);
   
   Pager* pager = malloc(sizeof(Pager));
   pager->file_descriptor = fd;
+  pager->backend = options->backend;
 
   pager->file_length = file_length;
+  read_page_format(pager, options);
+
+  // The mmap backend writes straight into the file, so there is nothing to
+  // log ahead of it; a log left by an earlier session is still replayed.
+  DbOptions wal_options = *options;
+  if (options->backend == PAGER_MMAP) {
+    wal_options.wal_mode = WAL_OFF;
+  }
+  pager->wal = wal_open(filename, &wal_options, pager->page_size);
 
-  if (file_length % PAGE_SIZE != 0) {
+  if (file_length % pager->page_size != 0) {
     printf("Db file is not a whole number of pages. Corrupt file.\n");
     exit(EXIT_FAILURE);
   }
 
-  for (uint32_t i = 0; i < TABLE_MAX_PAGES; i++) {
-    pager->pages[i] = NULL;
-  
+  // Frames up to the budget share one allocation; frames handed out past the
+  // budget (every frame pinned) are allocated one by one and released again
+  // by pager_unpin_all().
+  pager->max_frames = options->pool_frames;
+  if (pager->max_frames < MIN_POOL_FRAMES) {
+    pager->max_frames = MIN_POOL_FRAMES;
+  }
+  pager->frame_memory = NULL;
+  if (pager->backend == PAGER_BUFFERED) {
+    pager->frame_memory = malloc((size_t)pager->max_frames * pager->page_size);
   }
+  pager->frames_capacity = pager->max_frames;
+  pager->frames = malloc(pager->frames_capacity * sizeof(Frame));
+  page_table_init(&pager->page_table, pager->max_frames * 2);
+  pager->num_frames = 0;
+  pager->clock_hand = 0;
+  pager->readahead_max = options->readahead_pages;
+  if (pager->readahead_max > pager->max_frames / 2) {
+    pager->readahead_max = pager->max_frames / 2;
+  }
+  pager->hits = 0;
+  pager->misses = 0;
+  pager->evictions = 0;
+  pager->writebacks = 0;
+  pager->pages_written = 0;
+  pager->write_calls = 0;
+  pager->prefetched = 0;
+  io_engine_open(&pager->io, options->io_engine);
 
-  void* page0 =  malloc(PAGE_SIZE);
-  if(file_length!=0){
-    lseek(pager->file_descriptor, 0, SEEK_SET);
-    ssize_t bytes_read = read(pager->file_descriptor, page0, PAGE_SIZE);
-    if (bytes_read == -1) {
-      printf("Error reading file: %d\n", errno);
-      exit(EXIT_FAILURE);
-    } 
+  void* page0;
+  if (pager->backend == PAGER_MMAP) {
+    mmap_open(pager);
+    page0 = pager->map;
+  } else {
+    page0 =  malloc(pager->page_size);
+    if(file_length!=0){
+      ssize_t bytes_read = pread(pager->file_descriptor, page0, pager->page_size, 0);
+      if (bytes_read == -1) {
+        printf("Error reading file: %d\n", errno);
+        exit(EXIT_FAILURE);
+      } 
+    }
   }
-  pager->pages[0] = page0;
   pager->page_used = page0;
-  *is_page_used(pager,0) = true;
+  pager->header_dirty = (file_length == 0);
+  pager->header_uncommitted = (file_length == 0);
+  pager->num_pages = file_length / pager->page_size;
+  if (pager->num_pages == 0) {
+    pager->num_pages = 1;
+  }
+  pager->free_hint = 1;
 
+  uint32_t* header = page0;
   if(file_length==0){
+    memset(page0, 0, pager->page_size);
     *(table_root(pager)) =1;
-    for(int i=1;i<TABLE_MAX_PAGES;i++){
-      *(is_page_used(pager,i)) = false;
-    }
+    header[HEADER_MAGIC_OFFSET / sizeof(uint32_t)] = DB_MAGIC;
+    set_page_used(pager, 0, true);
+    write_page_format(pager);
+  } else if (header[HEADER_MAGIC_OFFSET / sizeof(uint32_t)] != DB_MAGIC) {
+    upgrade_header(pager);
   }
-  
+  // Older files get their new version recorded by table_upgrade_leaves(),
+  // in the same commit that replaces their leaves.
+
 
   return pager;
 }
 
+static void mark_header_dirty(Pager* pager) {
+  pager->header_dirty = true;
+  pager->header_uncommitted = true;
+}
+
+// A page may only reach the db file after the log records describing it are
+// on disk, so pending group commits are synced first.
+static void pager_write_page(Pager* pager, uint32_t page_num, void* data) {
+  if (pager->wal != NULL) {
+    wal_sync(pager->wal);
+  }
+  ssize_t bytes_written =
+      pwrite(pager->file_descriptor, data, pager->page_size, (off_t)page_num * pager->page_size);
+
+  if (bytes_written == -1) {
+    printf("Error writing: %d\n", errno);
+    exit(EXIT_FAILURE);
+  }
+  pager->pages_written++;
+  pager->write_calls++;
+}
+
+// CLOCK sweep over the budgeted frames. A referenced frame gets a second
+// chance; the first unpinned, unreferenced frame is written back if dirty and
+// handed out. Frames changed since the last commit are skipped while the log
+// is on, since their log records do not exist yet. Returns INVALID_FRAME_NUM
+// when every frame is pinned or uncommitted.
+uint32_t pager_evict_frame(Pager* pager) {
+  for (uint32_t i = 0; i < 2 * pager->max_frames; i++) {
+    uint32_t frame_num = pager->clock_hand;
+    Frame* frame = &pager->frames[frame_num];
+    pager->clock_hand = (pager->clock_hand + 1) % pager->max_frames;
+
+    if (frame->pin_count > 0 || (frame->uncommitted && pager->wal != NULL)) {
+      continue;
+    }
+    if (frame->referenced) {
+      frame->referenced = false;
+      continue;
+    }
+    if (frame->dirty) {
+      pager_write_page(pager, frame->page_num, frame->data);
+      pager->writebacks++;
+    }
+    page_table_remove(&pager->page_table, frame->page_num);
+    pager->evictions++;
+    return frame_num;
+  }
+  return INVALID_FRAME_NUM;
+}
+
+// Returns an unused budgeted frame, evicting one if needed, or
+// INVALID_FRAME_NUM when every frame is pinned.
+static uint32_t pager_take_frame(Pager* pager) {
+  if (pager->num_frames < pager->max_frames) {
+    uint32_t frame_num = pager->num_frames++;
+    pager->frames[frame_num].data = pager->frame_memory + (size_t)frame_num * pager->page_size;
+    return frame_num;
+  }
+  return pager_evict_frame(pager);
+}
+
+static uint32_t pager_alloc_frame(Pager* pager) {
+  uint32_t frame_num = pager_take_frame(pager);
+  if (frame_num != INVALID_FRAME_NUM) {
+    return frame_num;
+  }
+
+  if (pager->num_frames == pager->frames_capacity) {
+    pager->frames_capacity *= 2;
+    pager->frames = realloc(pager->frames, pager->frames_capacity * sizeof(Frame));
+  }
+  frame_num = pager->num_frames++;
+  pager->frames[frame_num].data = malloc(pager->page_size);
+  return frame_num;
+}
+
 void* get_page(Pager* pager, uint32_t page_num) {
-  if (page_num > TABLE_MAX_PAGES) {
-    printf("Tried to fetch page number out of bounds. %d > %d\n", page_num,
-           TABLE_MAX_PAGES);
+  if (page_num >= DB_MAX_PAGES) {
+    printf("Tried to fetch page number out of bounds. %u >= %u\n", page_num,
+           DB_MAX_PAGES);
     exit(EXIT_FAILURE);
   }
+  if (page_num == 0) {
+    return pager->page_used;
+  }
+  if (pager->backend == PAGER_MMAP) {
+    if (page_num >= pager->mapped_pages) {
+      mmap_grow(pager, page_num);
+    }
+    if (!is_page_used(pager, page_num)) {
+      set_page_used(pager, page_num, true);
+    }
+    pager->hits++;
+    return pager->map + (size_t)page_num * pager->page_size;
+  }
 
-  if (pager->pages[page_num] == NULL) {
-    void* page = malloc(PAGE_SIZE);
+  uint32_t frame_num = page_table_lookup(&pager->page_table, page_num);
+  if (frame_num != INVALID_FRAME_NUM) {
+    pager->hits++;
+  } else {
+    pager->misses++;
+    // The free map may itself have to be read into a frame, so it is
+    // consulted before this page's frame is taken.
+    bool used = is_page_used(pager, page_num);
+    if (!used) {
+      set_page_used(pager, page_num, true);
+    }
+    frame_num = pager_alloc_frame(pager);
+    void* page = pager->frames[frame_num].data;
+    ssize_t bytes_read = 0;
 
-    if (*(is_page_used(pager,page_num))) {
-      lseek(pager->file_descriptor, page_num * PAGE_SIZE, SEEK_SET);
-      ssize_t bytes_read = read(pager->file_descriptor, page, PAGE_SIZE);
+    if (used) {
+      bytes_read = pread(pager->file_descriptor, page, pager->page_size,
+                         (off_t)page_num * pager->page_size);
       if (bytes_read == -1) {
         printf("Error reading file: %d\n", errno);
         exit(EXIT_FAILURE);
       }
     }
-    *(is_page_used(pager,page_num)) = true;
-    pager->pages[page_num] = page;
+    memset(page + bytes_read, 0, pager->page_size - bytes_read);
+
+    Frame* frame = &pager->frames[frame_num];
+    frame->page_num = page_num;
+    frame->pin_count = 0;
+    frame->dirty = false;
+    frame->uncommitted = false;
+    page_table_insert(&pager->page_table, page_num, frame_num);
   }
 
-  return pager->pages[page_num];
+  Frame* frame = &pager->frames[frame_num];
+  frame->pin_count++;
+  frame->referenced = true;
+  return frame->data;
 }
 
+// Every path that writes into a page it got from get_page() must call this,
+// otherwise the change is dropped when the frame is evicted or the db closed.
+void mark_page_dirty(Pager* pager, void* page) {
+  if (page == pager->page_used) {
+    mark_header_dirty(pager);
+    return;
+  }
+  if (pager->backend == PAGER_MMAP) {
+    pager->map_dirty[(page - pager->map) / pager->page_size] = true;
+    return;
+  }
+  Frame* frame = NULL;
+  if (page >= pager->frame_memory &&
+      page < pager->frame_memory + (size_t)pager->max_frames * pager->page_size) {
+    frame = &pager->frames[(page - pager->frame_memory) / pager->page_size];
+  }
+  for (uint32_t i = pager->max_frames; frame == NULL && i < pager->num_frames; i++) {
+    if (pager->frames[i].data == page) {
+      frame = &pager->frames[i];
+    }
+  }
+  if (frame != NULL) {
+    frame->dirty = true;
+    frame->uncommitted = true;
+    return;
+  }
+  printf("Tried to mark a page dirty that is not in the buffer pool\n");
+  exit(EXIT_FAILURE);
+}
+
+void unpin_page(Pager* pager, uint32_t page_num) {
+  if (page_num == 0) {
+    return;
+  }
+  uint32_t frame_num = page_table_lookup(&pager->page_table, page_num);
+  if (frame_num != INVALID_FRAME_NUM && pager->frames[frame_num].pin_count > 0) {
+    pager->frames[frame_num].pin_count--;
+  }
+}
+
+// Tree operations hold raw page pointers across get_page() calls, so pages
+// stay pinned until the statement that fetched them is done. Frames handed
+// out past the budget in the meantime are written back and freed here, which
+// is only safe once they are committed: while the log is on, a page must not
+// reach the db file before its log record.
+void pager_unpin_all(Pager* pager) {
+  for (uint32_t i = 0; i < pager->num_frames; i++) {
+    pager->frames[i].pin_count = 0;
+  }
+  for (uint32_t i = pager->max_frames; i < pager->num_frames; i++) {
+    Frame* frame = &pager->frames[i];
+    if (frame->uncommitted && pager->wal != NULL) {
+      printf("Tried to write back page %u before committing it\n", frame->page_num);
+      exit(EXIT_FAILURE);
+    }
+    if (frame->dirty) {
+      pager_write_page(pager, frame->page_num, frame->data);
+      pager->writebacks++;
+    }
+    page_table_remove(&pager->page_table, frame->page_num);
+    pager->evictions++;
+    free(frame->data);
+  }
+  if (pager->num_frames > pager->max_frames) {
+    pager->num_frames = pager->max_frames;
+  }
+}
 
 void pager_flush(Pager* pager, uint32_t page_num) {
-  if (pager->pages[page_num] == NULL) {
+  if (page_num == 0) {
+    pager_write_page(pager, 0, pager->page_used);
+    pager->header_dirty = false;
+    return;
+  }
+  uint32_t frame_num = page_table_lookup(&pager->page_table, page_num);
+  if (frame_num == INVALID_FRAME_NUM) {
     printf("Tried to flush null page\n");
     exit(EXIT_FAILURE);
   }
 
-  off_t offset = lseek(pager->file_descriptor, page_num * PAGE_SIZE, SEEK_SET);
+  Frame* frame = &pager->frames[frame_num];
+  pager_write_page(pager, page_num, frame->data);
+  frame->dirty = false;
+}
+
+static int compare_frames_by_page(const void* a, const void* b) {
+  uint32_t page_a = (*(Frame**)a)->page_num;
+  uint32_t page_b = (*(Frame**)b)->page_num;
+  return (page_a > page_b) - (page_a < page_b);
+}
+
+// Writes every dirty page back and returns how many pages were written.
+// Pages that were only read are skipped. Dirty pages are written in page
+// order and each run of adjacent pages goes out as a single pwritev().
+uint32_t pager_flush_all(Pager* pager) {
+  if (pager->backend == PAGER_MMAP) {
+    return mmap_flush_all(pager);
+  }
+  if (pager->wal != NULL) {
+    wal_sync(pager->wal);
+  }
+
+  Frame header_frame = {0, 0, false, false, false, pager->page_used};
+  Frame** dirty = malloc((pager->num_frames + 1) * sizeof(Frame*));
+  uint32_t num_dirty = 0;
+  if (pager->header_dirty) {
+    dirty[num_dirty++] = &header_frame;
+  }
+  for (uint32_t i = 0; i < pager->num_frames; i++) {
+    if (pager->frames[i].dirty) {
+      dirty[num_dirty++] = &pager->frames[i];
+    }
+  }
+  qsort(dirty, num_dirty, sizeof(Frame*), compare_frames_by_page);
+
+  struct iovec* iov = malloc((num_dirty + 1) * sizeof(struct iovec));
+  IoRequest* requests = malloc((num_dirty + 1) * sizeof(IoRequest));
+  uint32_t num_requests = 0;
+  uint32_t i = 0;
+  while (i < num_dirty) {
+    uint32_t run_start = i;
+    do {
+      iov[i].iov_base = dirty[i]->data;
+      iov[i].iov_len = pager->page_size;
+      dirty[i]->dirty = false;
+      i++;
+    } while (i < num_dirty && i - run_start < FLUSH_MAX_RUN_PAGES &&
+             dirty[i]->page_num == dirty[i - 1]->page_num + 1);
+    IoRequest* request = &requests[num_requests++];
+    request->write = true;
+    request->offset = (off_t)dirty[run_start]->page_num * pager->page_size;
+    request->iov = &iov[run_start];
+    request->iov_count = i - run_start;
+  }
+
+  uint64_t syscalls = pager->io.syscalls;
+  io_engine_submit(&pager->io, pager->file_descriptor, requests, num_requests);
+  pager->write_calls += pager->io.syscalls - syscalls;
+  pager->pages_written += num_dirty;
+  pager->header_dirty = false;
+  free(requests);
+  free(iov);
+  free(dirty);
+  return num_dirty;
+}
+
+// Reads the given pages into the pool as one batch of I/O so the get_page()
+// calls that follow are hits. Pages that are resident or were never
+// allocated are skipped, and prefetching stops early when every frame is
+// pinned. Returns the number of pages read.
+uint32_t pager_prefetch(Pager* pager, uint32_t* page_nums, uint32_t count) {
+  if (pager->backend == PAGER_MMAP) {
+#ifdef HAVE_MMAP
+    for (uint32_t i = 0; i < count; i++) {
+      if (page_nums[i] < pager->mapped_pages) {
+        madvise(pager->map + (size_t)page_nums[i] * pager->page_size, pager->page_size, MADV_WILLNEED);
+      }
+    }
+#endif
+    return 0;
+  }
+
+  struct iovec* iov = malloc(count * sizeof(struct iovec));
+  IoRequest* requests = malloc(count * sizeof(IoRequest));
+  uint32_t* frame_nums = malloc(count * sizeof(uint32_t));
+  uint32_t n = 0;
+  uint32_t num_requests = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    uint32_t page_num = page_nums[i];
+    if (page_num == 0 || page_num >= pager->num_pages ||
+        page_table_lookup(&pager->page_table, page_num) != INVALID_FRAME_NUM ||
+        !is_page_used(pager, page_num)) {
+      continue;
+    }
+    uint32_t frame_num = pager_take_frame(pager);
+    if (frame_num == INVALID_FRAME_NUM) {
+      break;
+    }
+    // Pinned until the batch completes so the rest of the batch cannot
+    // evict it.
+    Frame* frame = &pager->frames[frame_num];
+    frame->page_num = page_num;
+    frame->pin_count = 1;
+    frame->dirty = false;
+    frame->uncommitted = false;
+    frame->referenced = true;
+    page_table_insert(&pager->page_table, page_num, frame_num);
+
+    iov[n].iov_base = frame->data;
+    iov[n].iov_len = pager->page_size;
+    // Pages that follow each other on disk (as read-ahead of a leaf chain
+    // usually asks for) share one request.
+    IoRequest* last = num_requests > 0 ? &requests[num_requests - 1] : NULL;
+    if (last != NULL && last->iov + last->iov_count == &iov[n] &&
+        last->offset + (off_t)last->iov_count * pager->page_size == (off_t)page_num * pager->page_size &&
+        last->iov_count < FLUSH_MAX_RUN_PAGES) {
+      last->iov_count++;
+    } else {
+      requests[num_requests].write = false;
+      requests[num_requests].offset = (off_t)page_num * pager->page_size;
+      requests[num_requests].iov = &iov[n];
+      requests[num_requests].iov_count = 1;
+      num_requests++;
+    }
+    frame_nums[n++] = frame_num;
+  }
+
+  io_engine_submit(&pager->io, pager->file_descriptor, requests, num_requests);
+  for (uint32_t i = 0; i < n; i++) {
+    pager->frames[frame_nums[i]].pin_count = 0;
+  }
+  pager->prefetched += n;
+  free(frame_nums);
+  free(requests);
+  free(iov);
+  return n;
+}
+
+// Waits between statements for input on stdin. Group commit otherwise only
+// syncs when the next statement commits, so the wait is cut short to sync the
+// last statements once they are group_commit_ms old.
+void pager_wait_for_input(Pager* pager) {
+  if (pager->wal == NULL) {
+    return;
+  }
+  int timeout = wal_sync_timeout_ms(pager->wal);
+  if (timeout < 0) {
+    return;
+  }
+  fflush(stdout);
+  struct pollfd input = {STDIN_FILENO, POLLIN, 0};
+  if (timeout == 0 || poll(&input, 1, timeout) == 0) {
+    wal_sync(pager->wal);
+  }
+}
+
+// Checkpoints, forgets every cached page and asks the kernel to drop its
+// copy of the file, so the next reads go to the device. Only called between
+// statements, when nothing is pinned.
+void pager_drop_cache(Pager* pager) {
+  pager_checkpoint(pager);
+  page_table_clear(&pager->page_table);
+  pager->num_frames = 0;
+  pager->clock_hand = 0;
+  posix_fadvise(pager->file_descriptor, 0, 0, POSIX_FADV_DONTNEED);
+}
+
+// Ends a statement: logs every page it changed as one commit. Runs before the
+// statement's pins are dropped so none of those pages can be evicted first.
+void pager_commit(Pager* pager) {
+  if (pager->wal == NULL) {
+    return;
+  }
+  uint32_t count = pager->header_uncommitted ? 1 : 0;
+  for (uint32_t i = 0; i < pager->num_frames; i++) {
+    if (pager->frames[i].uncommitted) {
+      count++;
+    }
+  }
+  if (count == 0) {
+    return;
+  }
 
-  if (offset == -1) {
-    printf("Error seeking: %d\n", errno);
+  uint32_t* page_nums = malloc(count * sizeof(uint32_t));
+  void** pages = malloc(count * sizeof(void*));
+  uint32_t n = 0;
+  for (uint32_t i = 0; i < pager->num_frames; i++) {
+    if (pager->frames[i].uncommitted) {
+      page_nums[n] = pager->frames[i].page_num;
+      pages[n++] = pager->frames[i].data;
+      pager->frames[i].uncommitted = false;
+    }
+  }
+  if (pager->header_uncommitted) {
+    page_nums[n] = 0;
+    pages[n++] = pager->page_used;
+    pager->header_uncommitted = false;
+  }
+  wal_append(pager->wal, page_nums, pages, count);
+  free(page_nums);
+  free(pages);
+
+  if (pager->wal->num_frames >= pager->wal->checkpoint_pages) {
+    pager_checkpoint(pager);
+  }
+}
+
+// Writes every dirty page into the db file, fsyncs it and empties the log.
+// Returns the number of pages written.
+uint32_t pager_checkpoint(Pager* pager) {
+  uint32_t flushed = pager_flush_all(pager);
+  if (fsync(pager->file_descriptor) == -1) {
+    printf("Error syncing db file: %d\n", errno);
     exit(EXIT_FAILURE);
   }
+  if (pager->wal != NULL) {
+    wal_reset(pager->wal);
+  }
+  return flushed;
+}
 
-  ssize_t bytes_written =
-      write(pager->file_descriptor, pager->pages[page_num], PAGE_SIZE);
+void pager_close(Pager* pager) {
+  pager_commit(pager);
+  pager_unpin_all(pager);
+  pager_checkpoint(pager);
+  if (pager->wal != NULL) {
+    wal_close(pager->wal);
+  }
 
-  if (bytes_written == -1) {
-    printf("Error writing: %d\n", errno);
+  int result = close(pager->file_descriptor);
+  if (result == -1) {
+    printf("Error closing db file.\n");
     exit(EXIT_FAILURE);
   }
+  io_engine_close(&pager->io);
+  if (pager->backend == PAGER_MMAP) {
+#ifdef HAVE_MMAP
+    munmap(pager->map, pager->map_reserved_pages * pager->page_size);
+#endif
+    free(pager->map_dirty);
+  } else {
+    free(pager->page_used);
+  }
+  free(pager->frame_memory);
+  free(pager->frames);
+  free(pager->page_table.page_nums);
+  free(pager->page_table.frame_nums);
+  free(pager);
 }
 
-bool* is_page_used(Pager* pager, uint32_t page_num){
-  return ((pager->page_used)+ PAGE_USED_OFFSET +page_num*PAGE_USED_SIZE);
-} 
+void print_pager_stats(Pager* pager) {
+  if (pager->backend == PAGER_MMAP) {
+    printf("mmap backend: %d pages mapped, %llu page lookups\n", pager->mapped_pages,
+           (unsigned long long)pager->hits);
+    printf("pages written: %llu\n", (unsigned long long)pager->pages_written);
+    return;
+  }
+  uint64_t requests = pager->hits + pager->misses;
+  printf("Buffer pool: %d/%d frames in use\n", pager->num_frames, pager->max_frames);
+  printf("hits: %llu, misses: %llu, hit rate: %.1f%%\n",
+         (unsigned long long)pager->hits, (unsigned long long)pager->misses,
+         requests == 0 ? 0.0 : 100.0 * pager->hits / requests);
+  printf("evictions: %llu, writebacks: %llu\n",
+         (unsigned long long)pager->evictions, (unsigned long long)pager->writebacks);
+  printf("pages written: %llu in %llu write calls\n",
+         (unsigned long long)pager->pages_written, (unsigned long long)pager->write_calls);
+  printf("io engine: %s, %llu pages prefetched\n", io_engine_name(&pager->io),
+         (unsigned long long)pager->prefetched);
+  if (pager->wal != NULL) {
+    print_wal_stats(pager->wal);
+  }
+}
+
+// Returns the free map of an extent. Maps after the first live in the first
+// page of their extent and are fetched through the pool like any other page.
+static uint64_t* free_map(Pager* pager, uint32_t extent, void** map_page) {
+  if (extent == 0) {
+    *map_page = pager->page_used;
+  } else {
+    uint32_t page_num = extent * PAGES_PER_EXTENT(pager);
+    // Stays pinned until the statement ends, as set_page_used() may have
+    // changed it and it must not reach the file before it is logged.
+    *map_page = get_page(pager, page_num);
+  }
+  return *map_page + FREE_MAP_OFFSET;
+}
+
+bool is_page_used(Pager* pager, uint32_t page_num) {
+  if (page_num % PAGES_PER_EXTENT(pager) == 0) {
+    return true;
+  }
+  void* map_page;
+  uint64_t* words = free_map(pager, page_num / PAGES_PER_EXTENT(pager), &map_page);
+  uint32_t bit = page_num % PAGES_PER_EXTENT(pager);
+  return (words[bit / 64] >> (bit % 64)) & 1;
+}
+
+void set_page_used(Pager* pager, uint32_t page_num, bool used) {
+  void* map_page;
+  uint64_t* words = free_map(pager, page_num / PAGES_PER_EXTENT(pager), &map_page);
+  uint32_t bit = page_num % PAGES_PER_EXTENT(pager);
+  if (used) {
+    words[bit / 64] |= (uint64_t)1 << (bit % 64);
+    if (page_num >= pager->num_pages) {
+      pager->num_pages = page_num + 1;
+    }
+  } else {
+    words[bit / 64] &= ~((uint64_t)1 << (bit % 64));
+    if (page_num < pager->free_hint) {
+      pager->free_hint = page_num;
+    }
+  }
+  mark_page_dirty(pager, map_page);
+}
 
 uint32_t * table_root(Pager * pager){
   return (pager->page_used); 
 }
 
+// Hands out the lowest free page. Every page below free_hint is known to be
+// in use, so the search starts there and tests 64 pages at a time.
 uint32_t get_unused_page_num(Pager* pager) { 
-  for(uint32_t i=0;i<TABLE_MAX_PAGES;i++){
-    if(!(*is_page_used(pager,i))){
-      *is_page_used(pager,i) = true;
-      return i;
+  uint64_t page_num = pager->free_hint;
+  while (page_num < DB_MAX_PAGES) {
+    uint32_t extent = page_num / PAGES_PER_EXTENT(pager);
+    void* map_page;
+    uint64_t* words = free_map(pager, extent, &map_page);
+    uint32_t bit = page_num % PAGES_PER_EXTENT(pager);
+    for (uint32_t w = bit / 64; w < FREE_MAP_WORDS(pager); w++) {
+      uint64_t used = words[w];
+      if (w == 0) {
+        used |= 1;  // the free map page itself
+      }
+      if (w == bit / 64) {
+        used |= ((uint64_t)1 << (bit % 64)) - 1;
+      }
+      if (~used == 0) {
+        continue;
+      }
+      uint64_t free_page = (uint64_t)extent * PAGES_PER_EXTENT(pager) + w * 64 + __builtin_ctzll(~used);
+      if (free_page >= DB_MAX_PAGES) {
+        break;
+      }
+      set_page_used(pager, free_page, true);
+      pager->free_hint = free_page + 1;
+      return free_page;
     }
-  }  
+    page_num = (uint64_t)(extent + 1) * PAGES_PER_EXTENT(pager);
+  }
   printf("Memory Full\n");
   exit(EXIT_FAILURE);
 
 }
 
+// Frees a page, first unlinking it from its neighbours when it is a leaf.
+// Internal nodes are not linked to their siblings.
 void delete_page(Pager* pager, uint32_t page_num){
   void * page = get_page(pager,page_num);
+  if(get_node_type(page)!=NODE_LEAF){
+    set_page_used(pager, page_num, false);
+    return;
+  }
   if(*node_next(page)!=INVALID_PAGE_NUM){
     void* node = get_page(pager,*node_next(page));
     *node_prev(node) = *node_prev(page);
+    mark_page_dirty(pager,node);
   }
   if(*node_prev(page)!=INVALID_PAGE_NUM){
     void* node = get_page(pager,*node_prev(page));
     *node_next(node) = *node_next(page);
+    mark_page_dirty(pager,node);
   }
 
-  *(is_page_used(pager,page_num)) = false;
+  set_page_used(pager, page_num, false);
 }
 
-void serialize_row(Row* source, void* destination) {
-  memcpy(destination + ID_OFFSET, &(source->id), ID_SIZE);
-  memcpy(destination + USERNAME_OFFSET, &(source->username), USERNAME_SIZE);
-  memcpy(destination + EMAIL_OFFSET, &(source->email), EMAIL_SIZE);
+// Returns the bytes serialize_row() writes for row.
+uint32_t serialized_row_size(Row* row) {
+  return ROW_MIN_SIZE + strlen(row->username) + strlen(row->email);
+}
+
+// Returns the bytes taken by a row serialized at value.
+uint32_t serialized_value_size(void* value) {
+  uint8_t username_length = *(uint8_t*)(value + ID_SIZE);
+  uint8_t email_length = *(uint8_t*)(value + ID_SIZE + ROW_LENGTH_SIZE + username_length);
+  return ROW_MIN_SIZE + username_length + email_length;
+}
+
+// Writes the row with each string behind its length, and returns the bytes
+// written.
+uint32_t serialize_row(Row* source, void* destination) {
+  uint8_t username_length = strlen(source->username);
+  uint8_t email_length = strlen(source->email);
+  memcpy(destination, &(source->id), ID_SIZE);
+  destination += ID_SIZE;
+  *(uint8_t*)destination = username_length;
+  memcpy(destination + ROW_LENGTH_SIZE, source->username, username_length);
+  destination += ROW_LENGTH_SIZE + username_length;
+  *(uint8_t*)destination = email_length;
+  memcpy(destination + ROW_LENGTH_SIZE, source->email, email_length);
+  return ROW_MIN_SIZE + username_length + email_length;
 }
 
 void deserialize_row(void* source, Row* destination) {
+  memcpy(&(destination->id), source, ID_SIZE);
+  source += ID_SIZE;
+  uint8_t username_length = *(uint8_t*)source;
+  memcpy(destination->username, source + ROW_LENGTH_SIZE, username_length);
+  destination->username[username_length] = '\0';
+  source += ROW_LENGTH_SIZE + username_length;
+  uint8_t email_length = *(uint8_t*)source;
+  memcpy(destination->email, source + ROW_LENGTH_SIZE, email_length);
+  destination->email[email_length] = '\0';
+}
+
+// Reads a row in the fixed width layout of files from before version 4.
+void deserialize_fixed_row(void* source, Row* destination) {
   memcpy(&(destination->id), source + ID_OFFSET, ID_SIZE);
   memcpy(&(destination->username), source + USERNAME_OFFSET, USERNAME_SIZE);
   memcpy(&(destination->email), source + EMAIL_OFFSET, EMAIL_SIZE);
 }
-
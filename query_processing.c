@@ -1,19 +1,143 @@
 #include "define.h"
 
 
-Table* db_open(const char* filename) {
-  Pager* pager = pager_open(filename);
+void default_db_options(DbOptions* options) {
+  options->backend = PAGER_BUFFERED;
+  options->io_engine = IO_ENGINE_SYNC;
+  options->pool_frames = DEFAULT_POOL_FRAMES;
+  options->readahead_pages = DEFAULT_READAHEAD_PAGES;
+  options->wal_mode = WAL_GROUP;
+  options->group_commit_size = DEFAULT_GROUP_COMMIT_SIZE;
+  options->group_commit_ms = DEFAULT_GROUP_COMMIT_MS;
+  options->checkpoint_pages = DEFAULT_CHECKPOINT_PAGES;
+  options->page_size = DEFAULT_PAGE_SIZE;
+  options->test_fanout = false;
+  options->lazy_deletes = false;
+}
+
+bool parse_db_option(DbOptions* options, const char* arg) {
+  if (strcmp(arg, "--backend=buffered") == 0) {
+    options->backend = PAGER_BUFFERED;
+    return true;
+  }
+  if (strcmp(arg, "--backend=mmap") == 0) {
+#ifdef HAVE_MMAP
+    options->backend = PAGER_MMAP;
+    return true;
+#else
+    printf("The mmap backend is not available in this build.\n");
+    return false;
+#endif
+  }
+  if (strcmp(arg, "--io=sync") == 0) {
+    options->io_engine = IO_ENGINE_SYNC;
+    return true;
+  }
+  if (strcmp(arg, "--io=uring") == 0) {
+    options->io_engine = IO_ENGINE_URING;
+    return true;
+  }
+  if (strncmp(arg, "--pool-frames=", 14) == 0) {
+    int frames = atoi(arg + 14);
+    if (frames <= 0) {
+      return false;
+    }
+    options->pool_frames = frames;
+    return true;
+  }
+  if (strncmp(arg, "--page-size=", 12) == 0) {
+    int page_size = atoi(arg + 12);
+    if (page_size < MIN_PAGE_SIZE || page_size > MAX_PAGE_SIZE ||
+        (page_size & (page_size - 1)) != 0) {
+      return false;
+    }
+    options->page_size = page_size;
+    return true;
+  }
+  if (strcmp(arg, "--test-fanout") == 0) {
+    options->test_fanout = true;
+    return true;
+  }
+  if (strcmp(arg, "--deletes=eager") == 0) {
+    options->lazy_deletes = false;
+    return true;
+  }
+  if (strcmp(arg, "--deletes=lazy") == 0) {
+    options->lazy_deletes = true;
+    return true;
+  }
+  if (strncmp(arg, "--readahead=", 12) == 0) {
+    int pages = atoi(arg + 12);
+    if (pages < 0) {
+      return false;
+    }
+    options->readahead_pages = pages;
+    return true;
+  }
+  if (strcmp(arg, "--wal=off") == 0) {
+    options->wal_mode = WAL_OFF;
+    return true;
+  }
+  if (strcmp(arg, "--wal=sync") == 0) {
+    options->wal_mode = WAL_SYNC;
+    return true;
+  }
+  if (strcmp(arg, "--wal=group") == 0) {
+    options->wal_mode = WAL_GROUP;
+    return true;
+  }
+  if (strncmp(arg, "--group-commit=", 15) == 0) {
+    int commits = atoi(arg + 15);
+    if (commits <= 0) {
+      return false;
+    }
+    options->group_commit_size = commits;
+    return true;
+  }
+  if (strncmp(arg, "--group-commit-ms=", 18) == 0) {
+    int ms = atoi(arg + 18);
+    if (ms < 0) {
+      return false;
+    }
+    options->group_commit_ms = ms;
+    return true;
+  }
+  if (strncmp(arg, "--checkpoint-pages=", 19) == 0) {
+    int pages = atoi(arg + 19);
+    if (pages <= 0) {
+      return false;
+    }
+    options->checkpoint_pages = pages;
+    return true;
+  }
+  return false;
+}
+
+Table* db_open(const char* filename, DbOptions* options) {
+  Pager* pager = pager_open(filename, options);
 
   Table* table = malloc(sizeof(Table));
   table->pager = pager;
   table->root_page_num = *(table_root(pager));
+  table->rightmost_page_num = INVALID_PAGE_NUM;
+  table->rightmost_version = 0;
+  table->tree_version = 0;
+  table->lazy_deletes = options->lazy_deletes;
+  table->filename = strdup(filename);
+  table->options = *options;
 
   if (pager->file_length == 0) {
 
     void* root_node = get_page(pager, 1);
     initialize_leaf_node(root_node);
     set_node_root(root_node, true);
+    mark_page_dirty(pager, root_node);
+    unpin_page(pager, 1);
   }
+  if (pager->leaf_version < LEAF_LAYOUT_VERSION) {
+    table_upgrade_leaves(table);
+  }
+  table_build_indexes(table);
 
   return table;
 }
@@ -50,30 +174,8 @@ void close_input_buffer(InputBuffer* input_buffer) {
 
 
 void db_close(Table* table) {
-  Pager* pager = table->pager;
-
-  for (uint32_t i = 0; i < TABLE_MAX_PAGES; i++) {
-    if (pager->pages[i] == NULL) {
-      continue;
-    }
-    pager_flush(pager, i);
-    free(pager->pages[i]);
-    pager->pages[i] = NULL;
-  }
-
-  int result = close(pager->file_descriptor);
-  if (result == -1) {
-    printf("Error closing db file.\n");
-    exit(EXIT_FAILURE);
-  }
-  for (uint32_t i = 0; i < TABLE_MAX_PAGES; i++) {
-    void* page = pager->pages[i];
-    if (page) {
-      free(page);
-      pager->pages[i] = NULL;
-    }
-  }
-  free(pager);
+  pager_close(table->pager);
+  free(table->filename);
   free(table);
 }
 
@@ -88,24 +190,101 @@ MetaCommandResult do_meta_command(InputBuffer* input_buffer, Table* table) {
     return META_COMMAND_SUCCESS;
   } else if (strcmp(input_buffer->buffer, ".constants") == 0) {
     printf("Constants:\n");
-    print_constants();
+    print_constants(table->pager);
+    return META_COMMAND_SUCCESS;
+  } else if (strcmp(input_buffer->buffer, ".checkpoint") == 0) {
+    printf("Checkpointed %d pages.\n", pager_checkpoint(table->pager));
+    return META_COMMAND_SUCCESS;
+  } else if (strcmp(input_buffer->buffer, ".flush") == 0) {
+    printf("Flushed %d pages.\n", pager_flush_all(table->pager));
+    return META_COMMAND_SUCCESS;
+  } else if (strcmp(input_buffer->buffer, ".bench scan") == 0) {
+    bench_scan(table);
+    return META_COMMAND_SUCCESS;
+  } else if (strcmp(input_buffer->buffer, ".bench readahead") == 0) {
+    bench_readahead(table);
+    return META_COMMAND_SUCCESS;
+  } else if (strcmp(input_buffer->buffer, ".bench insert") == 0) {
+    bench_insert(table);
+    return META_COMMAND_SUCCESS;
+  } else if (strcmp(input_buffer->buffer, ".bench search") == 0) {
+    bench_search(table);
+    return META_COMMAND_SUCCESS;
+  } else if (strcmp(input_buffer->buffer, ".bench keys") == 0) {
+    bench_keys(table);
+    return META_COMMAND_SUCCESS;
+  } else if (strncmp(input_buffer->buffer, ".load ", 6) == 0) {
+    strtok(input_buffer->buffer, " ");
+    char* filename = strtok(NULL, " ");
+    char* fill_string = strtok(NULL, " ");
+    if (filename == NULL) {
+      printf("Usage: .load <file.csv> [fill percent]\n");
+      return META_COMMAND_SUCCESS;
+    }
+    uint32_t fill_percent = BULK_LOAD_FILL_PERCENT;
+    if (fill_string != NULL) {
+      int fill = atoi(fill_string);
+      if (fill < 1 || fill > 100) {
+        printf("Fill factor must be a percentage from 1 to 100.\n");
+        return META_COMMAND_SUCCESS;
+      }
+      fill_percent = fill;
+    }
+    uint64_t start = now_us();
+    int64_t added = load_csv(table, filename, fill_percent);
+    if (added < 0) {
+      printf("Unable to open %s\n", filename);
+    } else {
+      printf("Loaded %lld rows in %.1f ms.\n", (long long)added, (now_us() - start) / 1000.0);
+    }
+    return META_COMMAND_SUCCESS;
+  } else if (strcmp(input_buffer->buffer, ".compact") == 0 ||
+             strncmp(input_buffer->buffer, ".compact ", 9) == 0) {
+    uint32_t fill_percent = BULK_LOAD_FILL_PERCENT;
+    if (input_buffer->buffer[8] != '\0') {
+      int fill = atoi(input_buffer->buffer + 9);
+      if (fill < 1 || fill > 100) {
+        printf("Fill factor must be a percentage from 1 to 100.\n");
+        return META_COMMAND_SUCCESS;
+      }
+      fill_percent = fill;
+    }
+    table_compact(table, fill_percent);
+    return META_COMMAND_SUCCESS;
+  } else if (strcmp(input_buffer->buffer, ".vacuum") == 0 ||
+             strncmp(input_buffer->buffer, ".vacuum ", 8) == 0) {
+    uint32_t fill_percent = BULK_LOAD_FILL_PERCENT;
+    if (input_buffer->buffer[7] != '\0') {
+      int fill = atoi(input_buffer->buffer + 8);
+      if (fill < 1 || fill > 100) {
+        printf("Fill factor must be a percentage from 1 to 100.\n");
+        return META_COMMAND_SUCCESS;
+      }
+      fill_percent = fill;
+    }
+    table_vacuum(table, fill_percent);
+    return META_COMMAND_SUCCESS;
+  } else if (strcmp(input_buffer->buffer, ".stats") == 0) {
+    print_pager_stats(table->pager);
     return META_COMMAND_SUCCESS;
   } else {
     return META_COMMAND_UNRECOGNIZED_COMMAND;
   }
 }
 
-PrepareResult prepare_insert(InputBuffer* input_buffer, Statement* statement) {
-  statement->type = STATEMENT_INSERT;
-
-  char* keyword = strtok(input_buffer->buffer, " ");
-  char* id_string = strtok(NULL, " ");
+// Reads the username and email that follow id_string in the statement being
+// tokenized. A comma ending the email separates it from the next row.
+static PrepareResult prepare_row(char* id_string, Row* row) {
   char* username = strtok(NULL, " ");
   char* email = strtok(NULL, " ");
 
   if (id_string == NULL || username == NULL || email == NULL) {
     return PREPARE_SYNTAX_ERROR;
   }
+  size_t email_length = strlen(email);
+  if (email_length > 1 && email[email_length - 1] == ',') {
+    email[email_length - 1] = '\0';
+  }
 
   int id = atoi(id_string);
   if (id < 0) {
@@ -118,13 +297,47 @@ PrepareResult prepare_insert(InputBuffer* input_buffer, Statement* statement) {
     return PREPARE_STRING_TOO_LONG;
   }
 
-  statement->row.id = id;
-  strcpy(statement->row.username, username);
-  strcpy(statement->row.email, email);
+  row->id = id;
+  strcpy(row->username, username);
+  strcpy(row->email, email);
 
   return PREPARE_SUCCESS;
 }
 
+// "insert 1 a a@x" inserts one row; "insert 1 a a@x, 2 b b@x, ..." inserts
+// the rows as one batch.
+PrepareResult prepare_insert(InputBuffer* input_buffer, Statement* statement) {
+  statement->type = STATEMENT_INSERT;
+
+  char* keyword = strtok(input_buffer->buffer, " ");
+  PrepareResult result = prepare_row(strtok(NULL, " "), &statement->row);
+  if (result != PREPARE_SUCCESS) {
+    return result;
+  }
+
+  char* id_string = strtok(NULL, " ");
+  if (id_string == NULL) {
+    return PREPARE_SUCCESS;
+  }
+  uint32_t capacity = 16;
+  statement->type = STATEMENT_INSERT_BATCH;
+  statement->rows = malloc(capacity * sizeof(Row));
+  statement->rows[0] = statement->row;
+  statement->num_rows = 1;
+  for (; id_string != NULL; id_string = strtok(NULL, " ")) {
+    if (statement->num_rows == capacity) {
+      capacity *= 2;
+      statement->rows = realloc(statement->rows, capacity * sizeof(Row));
+    }
+    result = prepare_row(id_string, &statement->rows[statement->num_rows++]);
+    if (result != PREPARE_SUCCESS) {
+      free(statement->rows);
+      return result;
+    }
+  }
+  return PREPARE_SUCCESS;
+}
+
 PrepareResult prepare_delete(InputBuffer* input_buffer, Statement* statement) {
   statement->type = STATEMENT_DELETE;
 
@@ -148,11 +361,50 @@ PrepareResult prepare_delete(InputBuffer* input_buffer, Statement* statement) {
   return PREPARE_SUCCESS;
 }
 
+// select where {username|email} = {value} returns the rows holding value in
+// that column, in id order, through the column's index.
+static PrepareResult prepare_select_index(Statement* statement) {
+  statement->type = STATEMENT_SELECT_INDEX;
+  char* column = strtok(NULL, " ");
+  char* equals = strtok(NULL, " ");
+  char* value = strtok(NULL, " ");
+
+  if (column == NULL || equals == NULL || value == NULL || strcmp(equals, "=") != 0 ||
+      strtok(NULL, " ") != NULL) {
+    return PREPARE_SYNTAX_ERROR;
+  }
+  statement->row.id = 0;
+  strcpy(statement->row.username, "");
+  strcpy(statement->row.email, "");
+  if (strcmp(column, "username") == 0) {
+    if (strlen(value) > COLUMN_USERNAME_SIZE) {
+      return PREPARE_STRING_TOO_LONG;
+    }
+    statement->index_column = INDEX_USERNAME;
+    strcpy(statement->row.username, value);
+  } else if (strcmp(column, "email") == 0) {
+    if (strlen(value) > COLUMN_EMAIL_SIZE) {
+      return PREPARE_STRING_TOO_LONG;
+    }
+    statement->index_column = INDEX_EMAIL;
+    strcpy(statement->row.email, value);
+  } else {
+    return PREPARE_SYNTAX_ERROR;
+  }
+  return PREPARE_SUCCESS;
+}
+
+// select {id} looks up one row. select {lo} {hi} [desc] [limit {n}] returns
+// the rows with lo <= id <= hi, in ascending order unless desc is given.
 PrepareResult prepare_select(InputBuffer* input_buffer, Statement* statement) {
   statement->type = STATEMENT_SELECT_ONE;
 
   char* keyword = strtok(input_buffer->buffer, " ");
   char* id_string = strtok(NULL, " ");
+  if (id_string != NULL && strcmp(id_string, "where") == 0) {
+    return prepare_select_index(statement);
+  }
+  char* hi_string = strtok(NULL, " ");
 
   if (id_string == NULL) {
     return PREPARE_SYNTAX_ERROR;
@@ -166,6 +418,35 @@ PrepareResult prepare_select(InputBuffer* input_buffer, Statement* statement) {
   statement->row.id = id;
   strcpy(statement->row.username,"");
   strcpy(statement->row.email,"");
+  if (hi_string == NULL) {
+    return PREPARE_SUCCESS;
+  }
+
+  int hi = atoi(hi_string);
+  if (hi < 0) {
+    return PREPARE_NEGATIVE_ID;
+  }
+  statement->type = STATEMENT_SELECT_RANGE;
+  statement->range_hi = hi;
+  statement->limit = UINT32_MAX;
+  statement->descending = false;
+
+  char* option;
+  while ((option = strtok(NULL, " ")) != NULL) {
+    if (strcmp(option, "desc") == 0) {
+      statement->descending = true;
+    } else if (strcmp(option, "asc") == 0) {
+      statement->descending = false;
+    } else if (strcmp(option, "limit") == 0) {
+      char* limit_string = strtok(NULL, " ");
+      if (limit_string == NULL || atoi(limit_string) < 0) {
+        return PREPARE_SYNTAX_ERROR;
+      }
+      statement->limit = atoi(limit_string);
+    } else {
+      return PREPARE_SYNTAX_ERROR;
+    }
+  }
   return PREPARE_SUCCESS;
 }
 
@@ -232,35 +513,92 @@ PrepareResult prepare_statement(InputBuffer* input_buffer,
 ExecuteResult execute_insert(Statement* statement, Table* table) {
   Row* row = &(statement->row);
   uint32_t key_to_insert = row->id;
-  Cursor* cursor = table_find(table, key_to_insert);
-  void* node = get_page(table->pager, cursor->page_num);
+  Cursor cursor;
+  table_find(table, key_to_insert, &cursor);
+  void* node = get_page(table->pager, cursor.page_num);
   uint32_t num_cells = *leaf_node_num_cells(node);
 
-  if (cursor->cell_num < num_cells) {
-    uint32_t key_at_index = *leaf_node_key(node, cursor->cell_num);
+  if (cursor.cell_num < num_cells) {
+    uint32_t key_at_index = *leaf_node_key(node, cursor.cell_num);
     if (key_at_index == key_to_insert) {
-      free(cursor);
       return EXECUTE_DUPLICATE_KEY;
     }
   }
-  printf("Cursor pg_no: %d cell_no: %d", cursor->page_num,cursor->cell_num);
-  leaf_node_insert(cursor, row->id, row);
+  printf("Cursor pg_no: %d cell_no: %d", cursor.page_num,cursor.cell_num);
+  leaf_node_insert(&cursor, row->id, row);
+  index_insert_row(table, row);
 
-  free(cursor);
+  return EXECUTE_SUCCESS;
+}
 
+ExecuteResult execute_insert_batch(Statement* statement, Table* table) {
+  uint32_t inserted = table_insert_batch(table, statement->rows, statement->num_rows);
+  if (inserted < statement->num_rows) {
+    printf("Skipped %d rows with duplicate ids.\n", statement->num_rows - inserted);
+  }
+  free(statement->rows);
   return EXECUTE_SUCCESS;
 }
 
 ExecuteResult execute_select(Statement* statement, Table* table) {
-  Cursor* cursor = table_start(table);
+  Cursor cursor;
+  RowBatch batch;
+  table_start(table, &cursor);
+  while (cursor_next_batch(&cursor, &batch)) {
+    for (uint32_t i = 0; i < batch.count; i++) {
+      print_row_value(batch.values[i]);
+    }
+  }
+
+  return EXECUTE_SUCCESS;
+}
+
+// Seeks to one end of the range and walks the leaf chain from there, so only
+// the leaves holding the range are read.
+ExecuteResult execute_select_range(Statement* statement, Table* table) {
+  uint32_t lo = statement->row.id;
+  uint32_t hi = statement->range_hi;
+  Cursor cursor;
+  if (statement->descending) {
+    table_seek_last(table, hi, &cursor);
+  } else {
+    table_seek(table, lo, &cursor);
+  }
+
   Row row;
-  while (!(cursor->end_of_table)) {
-    deserialize_row(cursor_value(cursor), &row);
+  uint32_t count = 0;
+  while (!cursor.end_of_table && count < statement->limit) {
+    uint32_t key = cursor_key(&cursor);
+    if (key < lo || key > hi) {
+      break;
+    }
+    deserialize_row(cursor_value(&cursor), &row);
     print_row(&row);
-    cursor_advance(cursor);
+    count++;
+    if (statement->descending) {
+      cursor_retreat(&cursor);
+    } else {
+      cursor_advance(&cursor);
+    }
   }
 
-  free(cursor);
+  return EXECUTE_SUCCESS;
+}
+
+// Walks the keys for the value in the column's index and looks each id up in
+// the table.
+ExecuteResult execute_select_index(Statement* statement, Table* table) {
+  IndexColumn column = statement->index_column;
+  KeyCursor index_cursor;
+  Row row;
+  for (index_seek(table, column, &statement->row, &index_cursor);
+       index_cursor_matches(&index_cursor, column, &statement->row);
+       key_cursor_advance(&index_cursor)) {
+    // A match can be anywhere in the table, so its pages are not kept pinned.
+    if (table_get_row(table, key_cursor_value(&index_cursor), &row)) {
+      print_row(&row);
+    }
+  }
 
   return EXECUTE_SUCCESS;
 }
@@ -268,64 +606,109 @@ ExecuteResult execute_select(Statement* statement, Table* table) {
 ExecuteResult execute_delete(Statement* statement, Table* table) {
   Row* row = &(statement->row);
   uint32_t key_to_delete = row->id;
-  Cursor* cursor = table_find(table, key_to_delete);
+  Cursor cursor;
+  table_find(table, key_to_delete, &cursor);
 
-  void* node = get_page(table->pager, cursor->page_num);
+  void* node = get_page(table->pager, cursor.page_num);
   uint32_t num_cells = *leaf_node_num_cells(node);
 
-  if (cursor->cell_num < num_cells) {
-    uint32_t key_at_index = *leaf_node_key(node, cursor->cell_num);
+  if (cursor.cell_num < num_cells) {
+    uint32_t key_at_index = *leaf_node_key(node, cursor.cell_num);
     if (key_at_index == key_to_delete) {
-      delete_from_leaf(cursor);
-      free(cursor);
+      Row deleted;
+      deserialize_row(cursor_value(&cursor), &deleted);
+      delete_from_leaf(&cursor);
+      index_delete_row(table, &deleted);
       return EXECUTE_SUCCESS;
     }
   }
-  free(cursor);
   return EXECUTE_KEY_NOT_FOUND;
 }
 
 ExecuteResult execute_select_one(Statement* statement, Table* table) {
-  Cursor* cursor = table_find(table, statement->row.id);
-  Row row;
-  
-  deserialize_row(cursor_value(cursor), &row);
-  if(row.id!=statement->row.id){
+  Cursor cursor;
+  table_find(table, statement->row.id, &cursor);
+
+  void* node = get_page(table->pager, cursor.page_num);
+  if (cursor.cell_num >= *leaf_node_num_cells(node) ||
+      *leaf_node_key(node, cursor.cell_num) != statement->row.id) {
     return EXECUTE_KEY_NOT_FOUND;
   }
+  Row row;
+  deserialize_row(cursor_value(&cursor), &row);
   print_row(&row);
-  free(cursor);
   return EXECUTE_SUCCESS;
 }
 
+// Rewrites the row in its leaf when the new id still belongs there, which
+// is always the case when the id is unchanged. Only a row that moves to
+// another leaf, or grows past the room left in its own, is deleted and
+// inserted again. An id already taken by another row leaves the table as it
+// was.
 ExecuteResult execute_update(Statement* statement, Table* table) {
-  Statement s1;
-  s1.row.id = statement->old_id;
-  strcpy(s1.row.username, "");
-  strcpy(s1.row.email, "");
-  s1.type = STATEMENT_DELETE;
-  int q = execute_delete(&s1,table);
-  if(q!=EXECUTE_SUCCESS){
-    return q;
-  }
-  Statement s2;
-  s2.type = STATEMENT_INSERT;
-  s2.row = statement->row;
-  return execute_insert(&s2,table);
+  Row* row = &(statement->row);
+  Cursor cursor;
+  table_find(table, statement->old_id, &cursor);
+  void* node = get_page(table->pager, cursor.page_num);
+  if (cursor.cell_num >= *leaf_node_num_cells(node) ||
+      *leaf_node_key(node, cursor.cell_num) != statement->old_id) {
+    return EXECUTE_KEY_NOT_FOUND;
+  }
+  Row old_row;
+  deserialize_row(cursor_value(&cursor), &old_row);
+
+  bool same_leaf = true;
+  uint32_t new_cell_num = cursor.cell_num;
+  if (row->id != statement->old_id) {
+    Cursor new_cursor;
+    table_find(table, row->id, &new_cursor);
+    void* new_node = get_page(table->pager, new_cursor.page_num);
+    if (new_cursor.cell_num < *leaf_node_num_cells(new_node) &&
+        *leaf_node_key(new_node, new_cursor.cell_num) == row->id) {
+      return EXECUTE_DUPLICATE_KEY;
+    }
+    same_leaf = new_cursor.page_num == cursor.page_num;
+    new_cell_num = new_cursor.cell_num;
+  }
 
+  if (!same_leaf || !leaf_node_update(&cursor, new_cell_num, row)) {
+    delete_from_leaf(&cursor);
+    table_find(table, row->id, &cursor);
+    leaf_node_insert(&cursor, row->id, row);
+  }
+  index_update_row(table, &old_row, row);
+  return EXECUTE_SUCCESS;
 }
 
 ExecuteResult execute_statement(Statement* statement, Table* table) {
+  ExecuteResult result = EXECUTE_SUCCESS;
   switch (statement->type) {
     case (STATEMENT_INSERT):
-      return execute_insert(statement, table);
+      result = execute_insert(statement, table);
+      break;
     case (STATEMENT_SELECT):
-      return execute_select(statement, table);
+      result = execute_select(statement, table);
+      break;
     case (STATEMENT_DELETE):
-      return execute_delete(statement,table);
+      result = execute_delete(statement,table);
+      break;
     case (STATEMENT_SELECT_ONE):
-      return execute_select_one(statement,table);
+      result = execute_select_one(statement,table);
+      break;
+    case (STATEMENT_SELECT_RANGE):
+      result = execute_select_range(statement, table);
+      break;
+    case (STATEMENT_SELECT_INDEX):
+      result = execute_select_index(statement, table);
+      break;
     case (STATEMENT_UPDATE):
-      return execute_update(statement,table);
+      result = execute_update(statement,table);
+      break;
+    case (STATEMENT_INSERT_BATCH):
+      result = execute_insert_batch(statement, table);
+      break;
   }
+  pager_commit(table->pager);
+  pager_unpin_all(table->pager);
+  return result;
 }
\ No newline at end of file
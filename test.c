@@ -1,12 +1,16 @@
 #include "define.h"
 
-void print_constants() {
-  printf("ROW_SIZE: %d\n", ROW_SIZE);
-  printf("COMMON_NODE_HEADER_SIZE: %d\n", COMMON_NODE_HEADER_SIZE);
-  printf("LEAF_NODE_HEADER_SIZE: %d\n", LEAF_NODE_HEADER_SIZE);
-  printf("LEAF_NODE_CELL_SIZE: %d\n", LEAF_NODE_CELL_SIZE);
-  printf("LEAF_NODE_SPACE_FOR_CELLS: %d\n", LEAF_NODE_SPACE_FOR_CELLS);
-  printf("LEAF_NODE_MAX_CELLS: %d\n", LEAF_NODE_MAX_CELLS);
+void print_constants(Pager* pager) {
+  printf("PAGE_SIZE: %d\n", pager->page_size);
+  printf("ROW_MIN_SIZE: %zu\n", ROW_MIN_SIZE);
+  printf("ROW_MAX_SIZE: %zu\n", ROW_MAX_SIZE);
+  printf("COMMON_NODE_HEADER_SIZE: %zu\n", COMMON_NODE_HEADER_SIZE);
+  printf("LEAF_NODE_HEADER_SIZE: %zu\n", LEAF_NODE_HEADER_SIZE);
+  printf("LEAF_NODE_MIN_CELL_SIZE: %zu\n", LEAF_NODE_MIN_CELL_SIZE);
+  printf("LEAF_NODE_MAX_CELL_SIZE: %zu\n", LEAF_NODE_MAX_CELL_SIZE);
+  printf("LEAF_NODE_SPACE_FOR_CELLS: %zu\n", LEAF_NODE_SPACE_FOR_CELLS(pager));
+  printf("LEAF_NODE_MAX_CELLS: %d\n", LEAF_NODE_MAX_CELLS(pager));
+  printf("INTERNAL_NODE_MAX_KEYS: %d\n", INTERNAL_NODE_MAX_KEYS(pager));
 }
 
 void indent(uint32_t level) {
@@ -19,6 +23,17 @@ void print_row(Row* row) {
   printf("(%d, %s, %s)\n", row->id, row->username, row->email);
 }
 
+// Prints a row straight from its serialized form in a leaf, without copying
+// it into a Row first.
+void print_row_value(void* value) {
+  uint32_t id;
+  memcpy(&id, value, ID_SIZE);
+  uint8_t* username = value + ID_SIZE;
+  uint8_t* email = username + ROW_LENGTH_SIZE + *username;
+  printf("(%d, %.*s, %.*s)\n", id, *username, (char*)(username + ROW_LENGTH_SIZE),
+         *email, (char*)(email + ROW_LENGTH_SIZE));
+}
+
 void print_tree(Pager* pager, uint32_t page_num, uint32_t indentation_level) {
   void* node = get_page(pager, page_num);
   uint32_t num_keys, child;
@@ -27,7 +42,7 @@ void print_tree(Pager* pager, uint32_t page_num, uint32_t indentation_level) {
     case (NODE_LEAF):
       num_keys = *leaf_node_num_cells(node);
       indent(indentation_level);
-      printf("- leaf (size %d) (page_no: %d, next: %d, prev:%d, par:%d )\n", num_keys,page_num,*node_next(node),*node_prev(node),*node_parent(node));
+      printf("- leaf (size %d) (page_no: %d, next: %d, prev:%d )\n", num_keys,page_num,*node_next(node),*node_prev(node));
       for (uint32_t i = 0; i < num_keys; i++) {
         indent(indentation_level + 1);
         printf("- %d\n", *leaf_node_key(node, i));
@@ -36,7 +51,7 @@ void print_tree(Pager* pager, uint32_t page_num, uint32_t indentation_level) {
     case (NODE_INTERNAL):
       num_keys = *internal_node_num_keys(node);
       indent(indentation_level);
-      printf("- internal (size %d) (page_no: %d, next: %d, prev:%d, par:%d )\n", num_keys,page_num,*node_next(node),*node_prev(node),*node_parent(node));
+      printf("- internal (size %d) (page_no: %d )\n", num_keys,page_num);
       if (num_keys > 0) {
         for (uint32_t i = 0; i < num_keys; i++) {
           child = *internal_node_child(node, i);
@@ -50,4 +65,322 @@ void print_tree(Pager* pager, uint32_t page_num, uint32_t indentation_level) {
       }
       break;
   }
+  unpin_page(pager, page_num);
+}
+
+
+// Times a cold-cache read of every page in the file with each io engine.
+// Pages are read in page order, one prefetch batch at a time.
+void bench_scan(Table* table) {
+  Pager* pager = table->pager;
+  if (pager->backend != PAGER_BUFFERED) {
+    printf("Scan benchmark needs the buffered backend.\n");
+    return;
+  }
+  uint32_t batch_size = PREFETCH_BATCH_PAGES;
+  if (batch_size > pager->max_frames / 2) {
+    batch_size = pager->max_frames / 2;
+  }
+
+  uint32_t* page_nums = malloc(pager->num_pages * sizeof(uint32_t));
+  uint32_t num_pages = 0;
+  for (uint32_t i = 1; i < pager->num_pages; i++) {
+    if (is_page_used(pager, i)) {
+      page_nums[num_pages++] = i;
+    }
+  }
+
+  IoEngineType original = pager->io.type;
+  IoEngineType engines[] = {IO_ENGINE_SYNC, IO_ENGINE_URING};
+  for (uint32_t e = 0; e < 2; e++) {
+    io_engine_close(&pager->io);
+    io_engine_open(&pager->io, engines[e]);
+    if (pager->io.type != engines[e]) {
+      continue;
+    }
+    pager_drop_cache(pager);
+
+    uint64_t syscalls = pager->io.syscalls;
+    uint64_t start = now_us();
+    for (uint32_t i = 0; i < num_pages; i += batch_size) {
+      uint32_t count = num_pages - i < batch_size ? num_pages - i : batch_size;
+      pager_prefetch(pager, &page_nums[i], count);
+      for (uint32_t j = i; j < i + count; j++) {
+        get_page(pager, page_nums[j]);
+        unpin_page(pager, page_nums[j]);
+      }
+    }
+    uint64_t elapsed = now_us() - start;
+    printf("%-12s %d pages in %.1f ms (%.1f MB/s), %llu syscalls\n",
+           io_engine_name(&pager->io), num_pages, elapsed / 1000.0,
+           elapsed == 0 ? 0.0 : (double)num_pages * pager->page_size / elapsed,
+           (unsigned long long)(pager->io.syscalls - syscalls));
+  }
+
+  io_engine_close(&pager->io);
+  io_engine_open(&pager->io, original);
+  free(page_nums);
+}
+
+// Times a cold-cache walk of the leaf chain with read-ahead off and on.
+void bench_readahead(Table* table) {
+  Pager* pager = table->pager;
+  uint32_t original = pager->readahead_max;
+  uint32_t limits[] = {0, original > 0 ? original : DEFAULT_READAHEAD_PAGES};
+  if (limits[1] > pager->max_frames / 2) {
+    limits[1] = pager->max_frames / 2;
+  }
+
+  for (uint32_t l = 0; l < 2; l++) {
+    pager->readahead_max = limits[l];
+    pager_drop_cache(pager);
+
+    uint64_t misses = pager->misses;
+    uint64_t prefetched = pager->prefetched;
+    uint64_t start = now_us();
+    uint32_t num_rows = 0;
+    Cursor cursor;
+    RowBatch batch;
+    table_start(table, &cursor);
+    while (cursor_next_batch(&cursor, &batch)) {
+      num_rows += batch.count;
+    }
+    pager_unpin_all(pager);
+    uint64_t elapsed = now_us() - start;
+    printf("read-ahead %-4d %d rows in %.1f ms, %llu misses, %llu pages read ahead\n",
+           limits[l], num_rows, elapsed / 1000.0,
+           (unsigned long long)(pager->misses - misses),
+           (unsigned long long)(pager->prefetched - prefetched));
+  }
+  pager->readahead_max = original;
+}
+
+// Inserts BENCH_INSERT_ROWS rows under random ids, each committed like a
+// statement, and reports the page lookups one insert costs. The rows are
+// deleted again afterwards.
+void bench_insert(Table* table) {
+  Pager* pager = table->pager;
+  uint32_t* keys = malloc(BENCH_INSERT_ROWS * sizeof(uint32_t));
+  Row row;
+  strcpy(row.username, "bench");
+  strcpy(row.email, "bench");
+  srand(1);
+
+  uint32_t num_rows = 0;
+  uint64_t lookups = pager->hits + pager->misses;
+  uint64_t start = now_us();
+  while (num_rows < BENCH_INSERT_ROWS) {
+    Cursor cursor;
+    row.id = rand();
+    table_find(table, row.id, &cursor);
+    void* node = get_page(pager, cursor.page_num);
+    if (cursor.cell_num < *leaf_node_num_cells(node) &&
+        *leaf_node_key(node, cursor.cell_num) == row.id) {
+      pager_unpin_all(pager);
+      continue;
+    }
+    leaf_node_insert(&cursor, row.id, &row);
+    pager_commit(pager);
+    pager_unpin_all(pager);
+    keys[num_rows++] = row.id;
+  }
+  uint64_t elapsed = now_us() - start;
+  lookups = pager->hits + pager->misses - lookups;
+
+  Cursor cursor;
+  table_find(table, keys[0], &cursor);
+  uint32_t height = cursor.path.depth + 1;
+  pager_unpin_all(pager);
+  for (uint32_t i = 0; i < num_rows; i++) {
+    table_find(table, keys[i], &cursor);
+    delete_from_leaf(&cursor);
+    pager_commit(pager);
+    pager_unpin_all(pager);
+  }
+  free(keys);
+
+  printf("%d inserts in %.1f ms, %.2f page lookups per insert, tree height %d\n",
+         num_rows, elapsed / 1000.0, (double)lookups / num_rows, height);
+}
+
+// Times key_search(), first on a full internal node at this file's fan-out,
+// then on point lookups through the tree with every page cached.
+void bench_search(Table* table) {
+  Pager* pager = table->pager;
+  uint32_t* keys = malloc(BENCH_SEARCH_LOOKUPS * sizeof(uint32_t));
+  void* node = calloc(1, pager->page_size);
+  uint32_t num_keys = INTERNAL_NODE_MAX_KEYS(pager);
+  initialize_internal_node(node);
+  for (uint32_t i = 0; i < num_keys; i++) {
+    *internal_node_cell(node, i) = i;
+    *internal_node_key(node, i) = 2 * i + 1;
+  }
+  *internal_node_num_keys(node) = num_keys;
+  *internal_node_right_child(node) = num_keys;
+
+  Cursor cursor;
+  table_seek_last(table, UINT32_MAX, &cursor);
+  uint32_t max_key = cursor.end_of_table ? 0 : cursor_key(&cursor);
+  pager_unpin_all(pager);
+
+  srand(1);
+  for (uint32_t i = 0; i < BENCH_SEARCH_LOOKUPS; i++) {
+    keys[i] = rand() % (2 * num_keys + 2);
+  }
+  uint64_t checksum = 0;
+  uint64_t start = now_us();
+  for (uint32_t i = 0; i < BENCH_SEARCH_LOOKUPS; i++) {
+    checksum += internal_node_find_child(node, keys[i]);
+  }
+  uint64_t node_elapsed = now_us() - start;
+
+  for (uint32_t i = 0; i < BENCH_SEARCH_LOOKUPS; i++) {
+    keys[i] = max_key == 0 ? 0 : rand() % max_key;
+  }
+  start = now_us();
+  for (uint32_t i = 0; i < BENCH_SEARCH_LOOKUPS; i++) {
+    table_find(table, keys[i], &cursor);
+    checksum += cursor.cell_num;
+    if (i % 256 == 255) {
+      pager_unpin_all(pager);
+    }
+  }
+  pager_unpin_all(pager);
+  uint64_t find_elapsed = now_us() - start;
+
+  printf("node of %d keys: %.1f ns/search; table: %.2f M lookups/s (checksum %llu)\n", num_keys,
+         node_elapsed * 1000.0 / BENCH_SEARCH_LOOKUPS,
+         find_elapsed == 0 ? 0.0 : (double)BENCH_SEARCH_LOOKUPS / find_elapsed,
+         (unsigned long long)checksum);
+  free(node);
+  free(keys);
+}
+
+typedef struct {
+  uint32_t height;
+  uint32_t leaves;
+  uint32_t internal_nodes;
+  uint64_t leaf_key_bytes;
+  uint64_t leaf_keys;
+  uint64_t separator_bytes;
+  uint64_t separators;
+} KeyTreeStats;
+
+static void key_tree_stats(Pager* pager, uint32_t page_num, uint32_t depth,
+                           KeyTreeStats* stats) {
+  void* node = get_page(pager, page_num);
+  uint32_t num_cells = *key_node_num_cells(node);
+  uint64_t key_bytes = 0;
+  for (uint32_t i = 0; i < num_cells; i++) {
+    key_bytes += key_node_key_length(node, i);
+  }
+  if (get_node_type(node) == NODE_LEAF) {
+    stats->height = depth + 1;
+    stats->leaves++;
+    stats->leaf_keys += num_cells;
+    stats->leaf_key_bytes += key_bytes;
+    return;
+  }
+  stats->internal_nodes++;
+  stats->separators += num_cells;
+  stats->separator_bytes += key_bytes;
+  for (uint32_t i = 0; i <= num_cells; i++) {
+    key_tree_stats(pager, key_node_child(node, i), depth + 1, stats);
+  }
+}
+
+// Inserts, looks up, scans and deletes BENCH_KEYS_COUNT keys in a scratch
+// key tree, each key stored in keys every BENCH_KEYS_STRIDE bytes.
+static void bench_key_tree(Table* table, const char* name, uint8_t* keys, uint32_t* lengths) {
+  Pager* pager = table->pager;
+  uint32_t root_page_num = key_tree_create(pager);
+
+  uint64_t start = now_us();
+  for (uint32_t i = 0; i < BENCH_KEYS_COUNT; i++) {
+    key_tree_insert(pager, root_page_num, keys + i * BENCH_KEYS_STRIDE, lengths[i], i);
+    if (i % 256 == 255) {
+      pager_commit(pager);
+      pager_unpin_all(pager);
+    }
+  }
+  pager_commit(pager);
+  pager_unpin_all(pager);
+  uint64_t insert_elapsed = now_us() - start;
+
+  uint32_t misses = 0;
+  KeyCursor cursor;
+  start = now_us();
+  for (uint32_t i = 0; i < BENCH_KEYS_COUNT; i++) {
+    key_tree_seek(pager, root_page_num, keys + i * BENCH_KEYS_STRIDE, lengths[i], &cursor);
+    if (cursor.end_of_tree || key_cursor_value(&cursor) != i) {
+      misses++;
+    }
+    if (i % 256 == 255) {
+      pager_unpin_all(pager);
+    }
+  }
+  pager_unpin_all(pager);
+  uint64_t lookup_elapsed = now_us() - start;
+
+  uint32_t scanned = 0;
+  for (key_tree_seek(pager, root_page_num, (const uint8_t*)"", 0, &cursor); !cursor.end_of_tree;
+       key_cursor_advance(&cursor)) {
+    if (++scanned % 256 == 0) {
+      pager_unpin_all(pager);
+    }
+  }
+  KeyTreeStats stats = {0};
+  key_tree_stats(pager, root_page_num, 0, &stats);
+  pager_unpin_all(pager);
+
+  start = now_us();
+  for (uint32_t i = 0; i < BENCH_KEYS_COUNT; i++) {
+    key_tree_delete(pager, root_page_num, keys + i * BENCH_KEYS_STRIDE, lengths[i]);
+    if (i % 256 == 255) {
+      pager_commit(pager);
+      pager_unpin_all(pager);
+    }
+  }
+  uint64_t delete_elapsed = now_us() - start;
+  key_tree_free(pager, root_page_num);
+  pager_commit(pager);
+  pager_unpin_all(pager);
+
+  printf("%s: insert %.0f ns, lookup %.0f ns, delete %.0f ns per key; %d missed, %d scanned\n",
+         name, insert_elapsed * 1000.0 / BENCH_KEYS_COUNT,
+         lookup_elapsed * 1000.0 / BENCH_KEYS_COUNT, delete_elapsed * 1000.0 / BENCH_KEYS_COUNT,
+         misses, scanned);
+  printf("  height %d, %d leaves, %d internal nodes, %.1f bytes per key, %.1f per separator\n",
+         stats.height, stats.leaves, stats.internal_nodes,
+         stats.leaf_keys == 0 ? 0.0 : (double)stats.leaf_key_bytes / stats.leaf_keys,
+         stats.separators == 0 ? 0.0 : (double)stats.separator_bytes / stats.separators);
+}
+
+// Times key trees on two kinds of keys in random order: email-like strings
+// that share long prefixes, and 64-bit ids stored big-endian.
+void bench_keys(Table* table) {
+  uint8_t* keys = malloc(BENCH_KEYS_COUNT * BENCH_KEYS_STRIDE);
+  uint32_t* lengths = malloc(BENCH_KEYS_COUNT * sizeof(uint32_t));
+  uint32_t* order = malloc(BENCH_KEYS_COUNT * sizeof(uint32_t));
+  srand(1);
+  for (uint32_t i = 0; i < BENCH_KEYS_COUNT; i++) {
+    uint32_t j = rand() % (i + 1);
+    order[i] = order[j];
+    order[j] = i;
+  }
+
+  for (uint32_t i = 0; i < BENCH_KEYS_COUNT; i++) {
+    lengths[i] = sprintf((char*)keys + i * BENCH_KEYS_STRIDE, "user%07d@example.com", order[i]);
+  }
+  bench_key_tree(table, "strings", keys, lengths);
+
+  for (uint32_t i = 0; i < BENCH_KEYS_COUNT; i++) {
+    key_encode_uint64((order[i] + 1) * 0x9E3779B97F4A7C15ull, keys + i * BENCH_KEYS_STRIDE);
+    lengths[i] = sizeof(uint64_t);
+  }
+  bench_key_tree(table, "uint64", keys, lengths);
+
+  free(order);
+  free(lengths);
+  free(keys);
 }
@@ -0,0 +1,257 @@
+#include "define.h"
+
+// The write-ahead log lives next to the db file as "<filename>-wal". Every
+// statement that changes pages appends an image of each changed page; the
+// last frame of a statement carries the commit flag. On open, frames up to the
+// last complete commit are copied into the db file and the log is emptied.
+//
+// header layout: magic | page size
+// frame layout: page_num | commit | checksum | unused | page image
+
+uint64_t now_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint32_t wal_checksum(uint32_t page_num, uint32_t commit, void* page,
+                             uint32_t page_size) {
+  uint32_t a = page_num + 1;
+  uint32_t b = commit;
+  uint32_t* words = page;
+  for (uint32_t i = 0; i < page_size / sizeof(uint32_t); i++) {
+    a += words[i];
+    b += a;
+  }
+  return a ^ (b << 1);
+}
+
+static char* wal_filename(const char* db_filename) {
+  char* filename = malloc(strlen(db_filename) + 5);
+  strcpy(filename, db_filename);
+  strcat(filename, "-wal");
+  return filename;
+}
+
+static void wal_write_header(int fd, uint32_t page_size) {
+  uint32_t header[2] = {WAL_MAGIC, page_size};
+  if (ftruncate(fd, 0) == -1 || write(fd, header, WAL_HEADER_SIZE) == -1) {
+    printf("Error writing wal header: %d\n", errno);
+    exit(EXIT_FAILURE);
+  }
+}
+
+// Copies every committed frame into the db file. Frames after the last commit
+// flag, or after the first frame that fails its checksum, were never
+// acknowledged and are dropped. The log records its own page size, so this
+// runs before the db header has been read.
+static uint32_t wal_replay(int fd, int db_fd) {
+  off_t wal_length = lseek(fd, 0, SEEK_END);
+  uint32_t header[2];
+  if (wal_length < (off_t)WAL_HEADER_SIZE ||
+      pread(fd, header, WAL_HEADER_SIZE, 0) != (ssize_t)WAL_HEADER_SIZE ||
+      header[0] != WAL_MAGIC || header[1] < MIN_PAGE_SIZE || header[1] > MAX_PAGE_SIZE) {
+    return 0;
+  }
+  uint32_t page_size = header[1];
+  size_t frame_size = WAL_FRAME_SIZE(page_size);
+
+  void* frame = malloc(frame_size);
+  uint32_t* frame_header = frame;
+  void* page = frame + WAL_FRAME_HEADER_SIZE;
+
+  off_t committed_end = WAL_HEADER_SIZE;
+  for (off_t offset = WAL_HEADER_SIZE; offset + (off_t)frame_size <= wal_length;
+       offset += frame_size) {
+    if (pread(fd, frame, frame_size, offset) != (ssize_t)frame_size ||
+        frame_header[2] != wal_checksum(frame_header[0], frame_header[1], page, page_size)) {
+      break;
+    }
+    if (frame_header[1]) {
+      committed_end = offset + frame_size;
+    }
+  }
+
+  uint32_t recovered = 0;
+  for (off_t offset = WAL_HEADER_SIZE; offset < committed_end;
+       offset += frame_size) {
+    pread(fd, frame, frame_size, offset);
+    if (pwrite(db_fd, page, page_size, (off_t)frame_header[0] * page_size) == -1) {
+      printf("Error writing: %d\n", errno);
+      exit(EXIT_FAILURE);
+    }
+    recovered++;
+  }
+  free(frame);
+
+  if (recovered > 0 && fsync(db_fd) == -1) {
+    printf("Error syncing db file: %d\n", errno);
+    exit(EXIT_FAILURE);
+  }
+  return recovered;
+}
+
+// Replays a log left behind by a crash into the db file. Runs before the db
+// file is read at all.
+uint32_t wal_recover(const char* db_filename, int db_fd) {
+  char* filename = wal_filename(db_filename);
+  int fd = open(filename, O_RDONLY);
+  free(filename);
+  if (fd == -1) {
+    return 0;
+  }
+  uint32_t recovered = wal_replay(fd, db_fd);
+  close(fd);
+  if (recovered > 0) {
+    printf("Recovered %d pages from the write-ahead log.\n", recovered);
+  }
+  return recovered;
+}
+
+// Returns an empty log to append to, or NULL when the log is turned off.
+// Called once wal_recover() has replayed whatever an earlier session left.
+Wal* wal_open(const char* db_filename, DbOptions* options, uint32_t page_size) {
+  char* filename = wal_filename(db_filename);
+  if (options->wal_mode == WAL_OFF) {
+    unlink(filename);
+    free(filename);
+    return NULL;
+  }
+  int fd = open(filename, O_RDWR | O_APPEND | O_CREAT, S_IWUSR | S_IRUSR);
+  free(filename);
+  if (fd == -1) {
+    printf("Unable to open wal file\n");
+    exit(EXIT_FAILURE);
+  }
+
+  wal_write_header(fd, page_size);
+  if (fsync(fd) == -1) {
+    printf("Error syncing wal file: %d\n", errno);
+    exit(EXIT_FAILURE);
+  }
+
+  Wal* wal = malloc(sizeof(Wal));
+  wal->file_descriptor = fd;
+  wal->page_size = page_size;
+  wal->mode = options->wal_mode;
+  wal->group_commit_size = options->group_commit_size;
+  wal->group_commit_ms = options->group_commit_ms;
+  wal->checkpoint_pages = options->checkpoint_pages;
+  wal->num_frames = 0;
+  wal->pending_commits = 0;
+  wal->first_pending_us = 0;
+  wal->buffer = NULL;
+  wal->buffer_frames = 0;
+  wal->opened_us = now_us();
+  wal->commits = 0;
+  wal->fsyncs = 0;
+  wal->checkpoints = 0;
+  wal->total_commit_us = 0;
+  wal->max_commit_us = 0;
+  return wal;
+}
+
+// Appends one committed statement with a single write. In sync mode the log
+// is fsynced before returning; in group mode the fsync is shared by up to
+// group_commit_size commits or group_commit_ms milliseconds of commits.
+void wal_append(Wal* wal, uint32_t* page_nums, void** pages, uint32_t count) {
+  uint64_t start = now_us();
+
+  size_t frame_size = WAL_FRAME_SIZE(wal->page_size);
+  if (count > wal->buffer_frames) {
+    wal->buffer = realloc(wal->buffer, count * frame_size);
+    wal->buffer_frames = count;
+  }
+  for (uint32_t i = 0; i < count; i++) {
+    void* frame = wal->buffer + i * frame_size;
+    uint32_t* frame_header = frame;
+    uint32_t commit = (i == count - 1);
+    memcpy(frame + WAL_FRAME_HEADER_SIZE, pages[i], wal->page_size);
+    frame_header[0] = page_nums[i];
+    frame_header[1] = commit;
+    frame_header[2] = wal_checksum(page_nums[i], commit, pages[i], wal->page_size);
+    frame_header[3] = 0;
+  }
+
+  size_t length = count * frame_size;
+  if (write(wal->file_descriptor, wal->buffer, length) != (ssize_t)length) {
+    printf("Error writing wal: %d\n", errno);
+    exit(EXIT_FAILURE);
+  }
+  wal->num_frames += count;
+  wal->commits++;
+
+  if (wal->pending_commits == 0) {
+    wal->first_pending_us = start;
+  }
+  wal->pending_commits++;
+  if (wal->mode == WAL_SYNC ||
+      wal->pending_commits >= wal->group_commit_size ||
+      now_us() - wal->first_pending_us >= (uint64_t)wal->group_commit_ms * 1000) {
+    wal_sync(wal);
+  }
+
+  uint64_t latency = now_us() - start;
+  wal->total_commit_us += latency;
+  if (latency > wal->max_commit_us) {
+    wal->max_commit_us = latency;
+  }
+}
+
+void wal_sync(Wal* wal) {
+  if (wal->pending_commits == 0) {
+    return;
+  }
+  if (fsync(wal->file_descriptor) == -1) {
+    printf("Error syncing wal file: %d\n", errno);
+    exit(EXIT_FAILURE);
+  }
+  wal->fsyncs++;
+  wal->pending_commits = 0;
+}
+
+// Returns how many milliseconds the oldest unsynced commit may still wait
+// before group commit must sync it, 0 if it is already due, or -1 when every
+// commit is synced.
+int wal_sync_timeout_ms(Wal* wal) {
+  if (wal->pending_commits == 0) {
+    return -1;
+  }
+  uint64_t due_us = wal->first_pending_us + (uint64_t)wal->group_commit_ms * 1000;
+  uint64_t now = now_us();
+  return now >= due_us ? 0 : (int)((due_us - now + 999) / 1000);
+}
+
+// Called once every logged page has reached the db file and been fsynced.
+void wal_reset(Wal* wal) {
+  wal_write_header(wal->file_descriptor, wal->page_size);
+  if (fsync(wal->file_descriptor) == -1) {
+    printf("Error syncing wal file: %d\n", errno);
+    exit(EXIT_FAILURE);
+  }
+  wal->num_frames = 0;
+  wal->pending_commits = 0;
+  wal->checkpoints++;
+}
+
+void wal_close(Wal* wal) {
+  if (close(wal->file_descriptor) == -1) {
+    printf("Error closing wal file.\n");
+    exit(EXIT_FAILURE);
+  }
+  free(wal->buffer);
+  free(wal);
+}
+
+void print_wal_stats(Wal* wal) {
+  double seconds = (now_us() - wal->opened_us) / 1000000.0;
+  printf("wal: %s, %d frames since checkpoint, %llu checkpoints\n",
+         wal->mode == WAL_SYNC ? "sync" : "group", wal->num_frames,
+         (unsigned long long)wal->checkpoints);
+  printf("commits: %llu, fsyncs: %llu (%.1f/sec)\n",
+         (unsigned long long)wal->commits, (unsigned long long)wal->fsyncs,
+         seconds > 0 ? wal->fsyncs / seconds : 0.0);
+  printf("commit latency: avg %.1f us, max %llu us\n",
+         wal->commits == 0 ? 0.0 : (double)wal->total_commit_us / wal->commits,
+         (unsigned long long)wal->max_commit_us);
+}